@@ -0,0 +1,17 @@
+VARYING vec3 normalDirection;
+VARYING vec2 texCoord;
+VARYING vec4 vertexColor;
+
+void MAIN()
+{
+    if (mode == 1) {
+        FRAGCOLOR = vec4(texture(uvTexture, texCoord).rgb, 1.0);
+    } else if (mode == 2) {
+        FRAGCOLOR = vertexColor;
+    } else {
+        // Lit from the camera, subsets without normals are flat
+        float directionLength = length(normalDirection);
+        float light = directionLength > 0.0 ? abs(dot(normalDirection / directionLength, CAMERA_DIRECTION)) : 1.0;
+        FRAGCOLOR = vec4(vec3(0.5) * (0.3 + 0.7 * light), 1.0);
+    }
+}
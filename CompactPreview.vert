@@ -0,0 +1,32 @@
+VARYING vec3 normalDirection;
+VARYING vec2 texCoord;
+VARYING vec4 vertexColor;
+
+// Same as GlyphTexture::unpackDirection
+vec3 unpackDirection(float packed)
+{
+    if (packed < 0.0)
+        return vec3(0.0);
+    uint bits = uint(packed);
+    vec2 e = (vec2(float(bits >> 12u), float(bits & 0xfffu)) - 2047.0) / 2047.0;
+    vec3 direction = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (direction.z < 0.0) {
+        vec2 signs = vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+        direction.xy = (1.0 - abs(e.yx)) * signs;
+    }
+    return normalize(direction);
+}
+
+void MAIN()
+{
+    // The attributes hold the packed words as exact float integers
+    uvec3 positionColor = uvec3(VERTEX);
+    uvec2 uv = uvec2(NORMAL.xy);
+
+    vec3 position = vec3(positionColor & 0xffffu) / 65535.0;
+    position = positionMin + position * positionExtent;
+    texCoord = vec2(unpackHalf2x16(uv.x & 0xffffu).x, unpackHalf2x16(uv.y).x);
+    normalDirection = NORMAL_MATRIX * unpackDirection(NORMAL.z);
+    vertexColor = vec4(uvec4(positionColor, uv.x) >> 16u) / 255.0;
+    POSITION = MODELVIEWPROJECTION_MATRIX * vec4(position, 1.0);
+}
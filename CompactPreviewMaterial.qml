@@ -0,0 +1,18 @@
+import QtQuick
+import QtQuick3D
+
+// Decodes the compact layout of GeometryGenerator.compactPreview
+CustomMaterial {
+    property vector3d positionMin
+    property vector3d positionExtent
+    // 0 shaded, 1 UV checker, 2 vertex colors
+    property int mode: 0
+    property TextureInput uvTexture: TextureInput {
+        texture: Texture {
+            source: "UVCheckerMap01.png"
+        }
+    }
+    shadingMode: CustomMaterial.Unshaded
+    fragmentShader: "CompactPreview.frag"
+    vertexShader: "CompactPreview.vert"
+}
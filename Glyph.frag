@@ -0,0 +1,4 @@
+void MAIN()
+{
+    FRAGCOLOR = glyphColor;
+}
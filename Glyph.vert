@@ -0,0 +1,30 @@
+// Same as GlyphTexture::unpackDirection
+vec3 unpackDirection(float packed)
+{
+    uint bits = uint(packed);
+    vec2 e = (vec2(float(bits >> 12u), float(bits & 0xfffu)) - 2047.0) / 2047.0;
+    vec3 direction = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (direction.z < 0.0) {
+        vec2 signs = vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+        direction.xy = (1.0 - abs(e.yx)) * signs;
+    }
+    return normalize(direction);
+}
+
+void MAIN()
+{
+    // VERTEX is the glyph within the chunk and the end of its line
+    int record = firstRecord + int(VERTEX.x);
+    vec4 texel = vec4(0.0, 0.0, 0.0, -1.0);
+    if (record < recordCount) {
+        // GlyphTexture::rowLength texels per row
+        texel = texelFetch(recordTexture, ivec2(record % 4096, record / 4096), 0);
+    }
+    if (texel.w < 0.0) {
+        // Zero directions and padding, outside the clip volume
+        POSITION = vec4(0.0, 0.0, 2.0, 1.0);
+    } else {
+        vec3 end = texel.xyz + unpackDirection(texel.w) * (glyphLength * VERTEX.y);
+        POSITION = MODELVIEWPROJECTION_MATRIX * vec4(end, 1.0);
+    }
+}
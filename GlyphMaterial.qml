@@ -0,0 +1,25 @@
+import QtQuick
+import QtQuick3D
+import MeshViewer
+
+// Draws one chunk of GeometryGenerator.glyph from the records of a GlyphTexture
+CustomMaterial {
+    property GlyphTexture records
+    property int firstRecord: 0
+    property real glyphLength: 1.0
+    property color glyphColor: "white"
+    property int recordCount: records ? records.recordCount : 0
+    property TextureInput recordTexture: TextureInput {
+        texture: Texture {
+            textureData: records
+            minFilter: Texture.Nearest
+            magFilter: Texture.Nearest
+            mipFilter: Texture.None
+            generateMipmaps: false
+        }
+    }
+    shadingMode: CustomMaterial.Unshaded
+    cullMode: Material.NoCulling
+    fragmentShader: "Glyph.frag"
+    vertexShader: "Glyph.vert"
+}
@@ -1,27 +1,37 @@
-QT += quick quick3d widgets
+QT += quick quick3d widgets concurrent
+
+!versionAtLeast(QT_VERSION, 6.5.0): error("MeshViewer needs Qt 6.5 or higher")
 
 CONFIG += qmltypes
 QML_IMPORT_NAME = MeshViewer
 QML_IMPORT_MAJOR_VERSION = 1
 
 HEADERS += \
+    attributedecoder.h \
     colordialoghelper.h \
+    diskcache.h \
     filedialoghelper.h \
     geometrygenerator.h \
+    glyphtexture.h \
     mesh.h \
     meshinfo.h \
     subsetdatatablemodel.h \
-    subsetlistmodel.h
+    subsetlistmodel.h \
+    tracing.h
 
 SOURCES += \
+    attributedecoder.cpp \
     colordialoghelper.cpp \
+    diskcache.cpp \
     filedialoghelper.cpp \
     geometrygenerator.cpp \
+    glyphtexture.cpp \
     main.cpp \
     mesh.cpp \
     meshinfo.cpp \
     subsetdatatablemodel.cpp \
-    subsetlistmodel.cpp
+    subsetlistmodel.cpp \
+    tracing.cpp
 
 RESOURCES += \
     qml.qrc
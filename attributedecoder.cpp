@@ -0,0 +1,479 @@
+/*
+ * Copyright (c) 2023 Andy Nichols <nezticle@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "attributedecoder.h"
+
+#include <QtCore/qfloat16.h>
+
+#include <climits>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESHVIEWER_DECODE_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define MESHVIEWER_DECODE_F16C
+#endif
+#if defined(MESHVIEWER_DECODE_F16C) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace AttributeDecoder {
+
+namespace {
+
+template <Mesh::ComponentType Type> struct Component;
+template <> struct Component<Mesh::UnsignedInt8> { using Storage = quint8; };
+template <> struct Component<Mesh::Int8> { using Storage = qint8; };
+template <> struct Component<Mesh::UnsignedInt16> { using Storage = quint16; };
+template <> struct Component<Mesh::Int16> { using Storage = qint16; };
+template <> struct Component<Mesh::UnsignedInt32> { using Storage = quint32; };
+template <> struct Component<Mesh::Int32> { using Storage = qint32; };
+template <> struct Component<Mesh::UnsignedInt64> { using Storage = quint64; };
+template <> struct Component<Mesh::Int64> { using Storage = qint64; };
+template <> struct Component<Mesh::Float16> { using Storage = qfloat16; };
+template <> struct Component<Mesh::Float32> { using Storage = float; };
+template <> struct Component<Mesh::Float64> { using Storage = double; };
+
+template <typename S>
+inline float toFloat(S value, bool normalized)
+{
+    if constexpr (std::is_same_v<S, qfloat16> || std::is_floating_point_v<S>) {
+        Q_UNUSED(normalized);
+        return float(value);
+    } else {
+        if (!normalized)
+            return float(value);
+        const float scaled = float(value) / float(std::numeric_limits<S>::max());
+        if constexpr (std::is_signed_v<S>)
+            return qMax(scaled, -1.0f);
+        else
+            return scaled;
+    }
+}
+
+inline void writeDefault(float *out, int outComponents)
+{
+    for (int c = 0; c < outComponents; ++c)
+        out[c] = c == 3 ? 1.0f : 0.0f;
+}
+
+// Number of vertices that can be read completely from the source
+quint64 vertexCount(const Source &source)
+{
+    const quint64 elementSize = quint64(componentSize(source.componentType)) * source.numComponents;
+    if (quint64(source.size) < source.offset + elementSize)
+        return 0;
+    if (source.stride == 0)
+        return std::numeric_limits<quint64>::max();
+    return (quint64(source.size) - source.offset - elementSize) / source.stride + 1;
+}
+
+template <typename S, int SourceComponents, int OutComponents>
+void gather(const Source &source, const quint32 *indexes, qsizetype count, float *out)
+{
+    const quint64 vertices = vertexCount(source);
+    const bool normalized = source.normalized;
+    const char *base = source.data + source.offset;
+    for (qsizetype i = 0; i < count; ++i, out += OutComponents) {
+        const quint32 index = indexes[i];
+        if (index >= vertices) {
+            writeDefault(out, OutComponents);
+            continue;
+        }
+        S values[SourceComponents];
+        memcpy(values, base + quint64(index) * source.stride, sizeof(values));
+        for (int c = 0; c < OutComponents; ++c) {
+            if (c < SourceComponents)
+                out[c] = toFloat(values[c], normalized);
+            else
+                out[c] = c == 3 ? 1.0f : 0.0f;
+        }
+    }
+}
+
+template <typename S, int SourceComponents>
+void gatherTo(const Source &source, const quint32 *indexes, qsizetype count, float *out, int outComponents)
+{
+    switch (outComponents) {
+    case 1:
+        gather<S, SourceComponents, 1>(source, indexes, count, out);
+        break;
+    case 2:
+        gather<S, SourceComponents, 2>(source, indexes, count, out);
+        break;
+    case 3:
+        gather<S, SourceComponents, 3>(source, indexes, count, out);
+        break;
+    case 4:
+        gather<S, SourceComponents, 4>(source, indexes, count, out);
+        break;
+    }
+}
+
+template <typename S>
+void gatherFrom(const Source &source, const quint32 *indexes, qsizetype count, float *out, int outComponents)
+{
+    switch (source.numComponents) {
+    case 1:
+        gatherTo<S, 1>(source, indexes, count, out, outComponents);
+        break;
+    case 2:
+        gatherTo<S, 2>(source, indexes, count, out, outComponents);
+        break;
+    case 3:
+        gatherTo<S, 3>(source, indexes, count, out, outComponents);
+        break;
+    case 4:
+        gatherTo<S, 4>(source, indexes, count, out, outComponents);
+        break;
+    }
+}
+
+#if defined(MESHVIEWER_DECODE_SSE2)
+// The SIMD kernels always load four components. Vertices where that would
+// read past the end of the source fall back to the scalar path.
+template <typename S>
+inline __m128 load4(const char *p)
+{
+    if constexpr (std::is_same_v<S, float>) {
+        return _mm_loadu_ps(reinterpret_cast<const float *>(p));
+    } else if constexpr (std::is_same_v<S, quint8> || std::is_same_v<S, qint8>) {
+        int packed;
+        memcpy(&packed, p, sizeof(packed));
+        __m128i v = _mm_cvtsi32_si128(packed);
+        if constexpr (std::is_signed_v<S>) {
+            v = _mm_unpacklo_epi8(v, v);
+            v = _mm_unpacklo_epi16(v, v);
+            v = _mm_srai_epi32(v, 24);
+        } else {
+            const __m128i zero = _mm_setzero_si128();
+            v = _mm_unpacklo_epi8(v, zero);
+            v = _mm_unpacklo_epi16(v, zero);
+        }
+        return _mm_cvtepi32_ps(v);
+    } else if constexpr (std::is_same_v<S, quint16> || std::is_same_v<S, qint16>) {
+        __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p));
+        if constexpr (std::is_signed_v<S>) {
+            v = _mm_unpacklo_epi16(v, v);
+            v = _mm_srai_epi32(v, 16);
+        } else {
+            v = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+        }
+        return _mm_cvtepi32_ps(v);
+#if defined(MESHVIEWER_DECODE_F16C)
+    } else if constexpr (std::is_same_v<S, qfloat16>) {
+        return _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+#endif
+    }
+}
+
+template <typename S>
+constexpr bool hasSimdLoad()
+{
+#if defined(MESHVIEWER_DECODE_F16C)
+    if constexpr (std::is_same_v<S, qfloat16>)
+        return true;
+#endif
+    return std::is_same_v<S, float> || std::is_same_v<S, quint8> || std::is_same_v<S, qint8>
+            || std::is_same_v<S, quint16> || std::is_same_v<S, qint16>;
+}
+
+template <typename S>
+void gatherSse(const Source &source, const quint32 *indexes, qsizetype count, float *out, int outComponents)
+{
+    const quint64 vertices = vertexCount(source);
+    const char *base = source.data + source.offset;
+    const char *end = source.data + source.size;
+    const int sourceComponents = int(source.numComponents);
+
+    // Lanes the source does not provide are replaced by (0, 0, 0, 1)
+    alignas(16) const qint32 laneMask[4] = {
+        sourceComponents > 0 ? -1 : 0,
+        sourceComponents > 1 ? -1 : 0,
+        sourceComponents > 2 ? -1 : 0,
+        sourceComponents > 3 ? -1 : 0
+    };
+    const __m128 mask = _mm_castsi128_ps(_mm_load_si128(reinterpret_cast<const __m128i *>(laneMask)));
+    const __m128 defaults = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+
+    __m128 scale = _mm_set1_ps(1.0f);
+    bool clamp = false;
+    if constexpr (std::is_integral_v<S>) {
+        if (source.normalized) {
+            scale = _mm_set1_ps(1.0f / float(std::numeric_limits<S>::max()));
+            clamp = std::is_signed_v<S>;
+        }
+    }
+    const __m128 minusOne = _mm_set1_ps(-1.0f);
+
+    alignas(16) float lanes[4];
+    for (qsizetype i = 0; i < count; ++i, out += outComponents) {
+        const quint32 index = indexes[i];
+        if (index >= vertices) {
+            writeDefault(out, outComponents);
+            continue;
+        }
+        const char *p = base + quint64(index) * source.stride;
+        if (end - p < qsizetype(4 * sizeof(S))) {
+            gatherFrom<S>(source, &indexes[i], 1, out, outComponents);
+            continue;
+        }
+        __m128 v = _mm_mul_ps(load4<S>(p), scale);
+        if (clamp)
+            v = _mm_max_ps(v, minusOne);
+        v = _mm_or_ps(_mm_and_ps(mask, v), _mm_andnot_ps(mask, defaults));
+        if (outComponents == 4) {
+            _mm_storeu_ps(out, v);
+        } else {
+            _mm_store_ps(lanes, v);
+            memcpy(out, lanes, outComponents * sizeof(float));
+        }
+    }
+}
+#endif
+
+#if defined(__AVX2__)
+// Gathers eight vertices at a time, one component per gather instruction.
+void gatherFloat32Avx2(const Source &source, const quint32 *indexes, qsizetype count, float *out, int outComponents)
+{
+    const quint64 vertices = vertexCount(source);
+    if (vertices == 0) {
+        gatherFrom<float>(source, indexes, count, out, outComponents);
+        return;
+    }
+    const int sourceComponents = int(source.numComponents);
+    const float *base = reinterpret_cast<const float *>(source.data + source.offset);
+    const __m256i stride = _mm256_set1_epi32(int(source.stride));
+    const __m256i lastVertex = _mm256_set1_epi32(int(qMin(vertices, quint64(INT_MAX)) - 1));
+
+    alignas(32) float components[4][8];
+    qsizetype i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(indexes + i));
+        // Unsigned compare through the sign bit, any index past the end takes the slow path
+        const __m256i signBit = _mm256_set1_epi32(INT_MIN);
+        const __m256i outOfRange = _mm256_cmpgt_epi32(_mm256_xor_si256(index, signBit),
+                                                      _mm256_xor_si256(lastVertex, signBit));
+        if (!_mm256_testz_si256(outOfRange, outOfRange)) {
+            gatherFrom<float>(source, indexes + i, 8, out, outComponents);
+            out += 8 * outComponents;
+            continue;
+        }
+        const __m256i byteOffsets = _mm256_mullo_epi32(index, stride);
+        for (int c = 0; c < outComponents; ++c) {
+            if (c < sourceComponents) {
+                const __m256 v = _mm256_i32gather_ps(base + c, byteOffsets, 1);
+                _mm256_store_ps(components[c], v);
+            } else {
+                _mm256_store_ps(components[c], _mm256_set1_ps(c == 3 ? 1.0f : 0.0f));
+            }
+        }
+        for (int v = 0; v < 8; ++v) {
+            for (int c = 0; c < outComponents; ++c)
+                *out++ = components[c][v];
+        }
+    }
+    if (i < count)
+        gatherFrom<float>(source, indexes + i, count - i, out, outComponents);
+}
+#endif
+
+template <typename S>
+void decodeAs(const Source &source, const quint32 *indexes, qsizetype count, float *out, int outComponents)
+{
+#if defined(__AVX2__)
+    // Byte offsets are computed in 32 bits
+    if constexpr (std::is_same_v<S, float>) {
+        if (source.size <= qsizetype(INT_MAX)) {
+            gatherFloat32Avx2(source, indexes, count, out, outComponents);
+            return;
+        }
+    }
+#endif
+#if defined(MESHVIEWER_DECODE_SSE2)
+    if constexpr (hasSimdLoad<S>()) {
+        gatherSse<S>(source, indexes, count, out, outComponents);
+        return;
+    }
+#endif
+    gatherFrom<S>(source, indexes, count, out, outComponents);
+}
+
+bool isValid(const Source &source, int outComponents)
+{
+    return isSupported(source.componentType)
+            && source.numComponents >= 1 && source.numComponents <= 4
+            && outComponents >= 1 && outComponents <= 4
+            && source.data != nullptr;
+}
+
+template <typename S>
+float referenceComponent(const char *p, bool normalized)
+{
+    S value;
+    memcpy(&value, p, sizeof(S));
+    return toFloat(value, normalized);
+}
+
+} // namespace
+
+bool isSupported(Mesh::ComponentType componentType)
+{
+    return componentType >= Mesh::UnsignedInt8 && componentType <= Mesh::Float64;
+}
+
+int componentSize(Mesh::ComponentType componentType)
+{
+    switch (componentType) {
+    case Mesh::UnsignedInt8:
+    case Mesh::Int8:
+        return 1;
+    case Mesh::UnsignedInt16:
+    case Mesh::Int16:
+    case Mesh::Float16:
+        return 2;
+    case Mesh::UnsignedInt32:
+    case Mesh::Int32:
+    case Mesh::Float32:
+        return 4;
+    case Mesh::UnsignedInt64:
+    case Mesh::Int64:
+    case Mesh::Float64:
+        return 8;
+    }
+    return 0;
+}
+
+bool decode(const Source &source, const quint32 *indexes, qsizetype count,
+            float *out, int outComponents)
+{
+    if (!isValid(source, outComponents))
+        return false;
+
+    switch (source.componentType) {
+    case Mesh::UnsignedInt8:
+        decodeAs<Component<Mesh::UnsignedInt8>::Storage>(source, indexes, count, out, outComponents);
+        break;
+    case Mesh::Int8:
+        decodeAs<Component<Mesh::Int8>::Storage>(source, indexes, count, out, outComponents);
+        break;
+    case Mesh::UnsignedInt16:
+        decodeAs<Component<Mesh::UnsignedInt16>::Storage>(source, indexes, count, out, outComponents);
+        break;
+    case Mesh::Int16:
+        decodeAs<Component<Mesh::Int16>::Storage>(source, indexes, count, out, outComponents);
+        break;
+    case Mesh::UnsignedInt32:
+        decodeAs<Component<Mesh::UnsignedInt32>::Storage>(source, indexes, count, out, outComponents);
+        break;
+    case Mesh::Int32:
+        decodeAs<Component<Mesh::Int32>::Storage>(source, indexes, count, out, outComponents);
+        break;
+    case Mesh::UnsignedInt64:
+        decodeAs<Component<Mesh::UnsignedInt64>::Storage>(source, indexes, count, out, outComponents);
+        break;
+    case Mesh::Int64:
+        decodeAs<Component<Mesh::Int64>::Storage>(source, indexes, count, out, outComponents);
+        break;
+    case Mesh::Float16:
+        decodeAs<Component<Mesh::Float16>::Storage>(source, indexes, count, out, outComponents);
+        break;
+    case Mesh::Float32:
+        decodeAs<Component<Mesh::Float32>::Storage>(source, indexes, count, out, outComponents);
+        break;
+    case Mesh::Float64:
+        decodeAs<Component<Mesh::Float64>::Storage>(source, indexes, count, out, outComponents);
+        break;
+    }
+    return true;
+}
+
+bool decodeReference(const Source &source, const quint32 *indexes, qsizetype count,
+                     float *out, int outComponents)
+{
+    if (!isValid(source, outComponents))
+        return false;
+
+    const int size = componentSize(source.componentType);
+    const quint64 vertices = vertexCount(source);
+    for (qsizetype i = 0; i < count; ++i) {
+        float *vertex = out + i * outComponents;
+        if (indexes[i] >= vertices) {
+            writeDefault(vertex, outComponents);
+            continue;
+        }
+        const char *p = source.data + source.offset + quint64(indexes[i]) * source.stride;
+        for (int c = 0; c < outComponents; ++c) {
+            if (c >= int(source.numComponents)) {
+                vertex[c] = c == 3 ? 1.0f : 0.0f;
+                continue;
+            }
+            const char *component = p + c * size;
+            switch (source.componentType) {
+            case Mesh::UnsignedInt8:
+                vertex[c] = referenceComponent<quint8>(component, source.normalized);
+                break;
+            case Mesh::Int8:
+                vertex[c] = referenceComponent<qint8>(component, source.normalized);
+                break;
+            case Mesh::UnsignedInt16:
+                vertex[c] = referenceComponent<quint16>(component, source.normalized);
+                break;
+            case Mesh::Int16:
+                vertex[c] = referenceComponent<qint16>(component, source.normalized);
+                break;
+            case Mesh::UnsignedInt32:
+                vertex[c] = referenceComponent<quint32>(component, source.normalized);
+                break;
+            case Mesh::Int32:
+                vertex[c] = referenceComponent<qint32>(component, source.normalized);
+                break;
+            case Mesh::UnsignedInt64:
+                vertex[c] = referenceComponent<quint64>(component, source.normalized);
+                break;
+            case Mesh::Int64:
+                vertex[c] = referenceComponent<qint64>(component, source.normalized);
+                break;
+            case Mesh::Float16:
+                vertex[c] = referenceComponent<qfloat16>(component, source.normalized);
+                break;
+            case Mesh::Float32:
+                vertex[c] = referenceComponent<float>(component, source.normalized);
+                break;
+            case Mesh::Float64:
+                vertex[c] = referenceComponent<double>(component, source.normalized);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace AttributeDecoder
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2023 Andy Nichols <nezticle@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ATTRIBUTEDECODER_H
+#define ATTRIBUTEDECODER_H
+
+#include "mesh.h"
+
+// Gathers one vertex attribute out of an interleaved vertex buffer into
+// packed floats, converting from the stored component type on the way.
+namespace AttributeDecoder {
+
+struct Source {
+    const char *data = nullptr;
+    qsizetype size = 0;
+    quint32 stride = 0;
+    quint32 offset = 0;
+    Mesh::ComponentType componentType = Mesh::Float32;
+    quint32 numComponents = 0;
+    // Integer components are mapped to [0, 1] or [-1, 1]
+    bool normalized = false;
+};
+
+// Writes count * outComponents floats to out, reading the vertex for each
+// of the count indexes. Components the source does not have are written as
+// 0, except the fourth which is written as 1. Indexes that point outside of
+// the source data decode to that default value.
+bool decode(const Source &source, const quint32 *indexes, qsizetype count,
+            float *out, int outComponents);
+
+// Straightforward per component implementation the decode kernels are
+// checked against.
+bool decodeReference(const Source &source, const quint32 *indexes, qsizetype count,
+                     float *out, int outComponents);
+
+bool isSupported(Mesh::ComponentType componentType);
+int componentSize(Mesh::ComponentType componentType);
+
+}
+
+#endif // ATTRIBUTEDECODER_H
@@ -0,0 +1,481 @@
+/*
+ * Copyright (c) 2023 Andy Nichols <nezticle@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "diskcache.h"
+#include "tracing.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <QThreadPool>
+
+namespace {
+const quint32 formatVersion = 6;
+const char fileMagic[8] = { 'M', 'V', 'C', 'A', 'C', 'H', 'E', '\0' };
+const QString fileSuffix = QStringLiteral(".mvcache");
+
+struct FileHeader {
+    char magic[8];
+    quint32 formatVersion;
+    quint32 sectionCount;
+    char viewerVersion[16];
+};
+static_assert(sizeof(FileHeader) == 32);
+
+struct SectionEntry {
+    quint32 tag;
+    qint32 channel;
+    quint64 offset;
+    quint64 size;
+};
+static_assert(sizeof(SectionEntry) == 24);
+
+// Sections start at 16 byte boundaries, so the mapped arrays are aligned for SIMD loads
+quint64 alignedOffset(quint64 offset)
+{
+    return (offset + 15) & ~quint64(15);
+}
+
+struct State {
+    QMutex mutex;
+    bool enabled = false;
+    QString directory;
+    qint64 maxSize = qint64(2) * 1024 * 1024 * 1024;
+    QSet<QString> pendingWrites;
+    // A single writer thread, writes and evictions never overlap
+    QThreadPool writer;
+
+    State() { writer.setMaxThreadCount(1); }
+};
+
+State &state()
+{
+    static State state;
+    return state;
+}
+
+QByteArray viewerVersion()
+{
+    return QCoreApplication::applicationVersion().toLatin1().left(sizeof(FileHeader::viewerVersion) - 1);
+}
+
+QString filePath(const QString &key)
+{
+    return DiskCache::directory() + QLatin1Char('/') + key + fileSuffix;
+}
+
+template <typename T>
+bool restoreArray(const DiskCache::Record &record, quint32 tag, int count, QVector<T> *values)
+{
+    if (!record.contains(tag))
+        return false;
+    // Empty when the mesh has no such attribute
+    QVector<T> restored = record.array<T>(tag);
+    if (!restored.isEmpty() && restored.size() != count)
+        return false;
+    *values = restored;
+    return true;
+}
+
+template <typename T>
+bool restoreChannels(const DiskCache::Record &record, quint32 tag, int count, QMap<int, QVector<T>> *channels)
+{
+    QMap<int, QVector<T>> restored;
+    for (qint32 channel : record.channels(tag)) {
+        QVector<T> values = record.array<T>(tag, channel);
+        if (values.size() != count)
+            return false;
+        restored.insert(channel, values);
+    }
+    *channels = restored;
+    return true;
+}
+
+template <typename T>
+void appendChannels(QVector<DiskCache::Section> *sections, quint32 tag, const QMap<int, QVector<T>> &channels)
+{
+    for (auto it = channels.cbegin(); it != channels.cend(); ++it)
+        sections->append(DiskCache::section(tag, it.key(), it.value()));
+}
+}
+
+DiskCache::Section DiskCache::section(quint32 tag, qint32 channel, const QByteArray &bytes)
+{
+    auto owner = std::make_shared<const QByteArray>(bytes);
+    return { tag, channel, owner->constData(), owner->size(), owner };
+}
+
+bool DiskCache::Record::contains(quint32 tag, qint32 channel) const
+{
+    return m_sections.contains(sectionKey(tag, channel));
+}
+
+QVector<qint32> DiskCache::Record::channels(quint32 tag) const
+{
+    QVector<qint32> channels;
+    for (auto it = m_sections.lowerBound(sectionKey(tag, 0)); it != m_sections.cend() && quint32(it.key() >> 32) == tag; ++it)
+        channels.append(qint32(quint32(it.key())));
+    return channels;
+}
+
+QByteArray DiskCache::Record::bytes(quint32 tag, qint32 channel) const
+{
+    const auto it = m_sections.constFind(sectionKey(tag, channel));
+    if (it == m_sections.cend())
+        return QByteArray();
+    return QByteArray(m_data + it->offset, it->size);
+}
+
+bool DiskCache::isEnabled()
+{
+    QMutexLocker locker(&state().mutex);
+    return state().enabled;
+}
+
+void DiskCache::setEnabled(bool enabled)
+{
+    QMutexLocker locker(&state().mutex);
+    state().enabled = enabled;
+}
+
+QString DiskCache::directory()
+{
+    QMutexLocker locker(&state().mutex);
+    if (state().directory.isEmpty())
+        state().directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + u"/meshes"_qs;
+    return state().directory;
+}
+
+void DiskCache::setDirectory(const QString &directory)
+{
+    QMutexLocker locker(&state().mutex);
+    state().directory = directory;
+}
+
+qint64 DiskCache::maxSize()
+{
+    QMutexLocker locker(&state().mutex);
+    return state().maxSize;
+}
+
+void DiskCache::setMaxSize(qint64 maxSize)
+{
+    {
+        QMutexLocker locker(&state().mutex);
+        state().maxSize = maxSize;
+    }
+    state().writer.start(&DiskCache::evict);
+}
+
+void DiskCache::configureFromEnvironment()
+{
+    const QString cache = qEnvironmentVariable("MESHVIEWER_DISK_CACHE");
+    if (cache == u"0"_qs) {
+        setEnabled(false);
+        return;
+    }
+    if (!cache.isEmpty())
+        setDirectory(cache);
+
+    bool ok = false;
+    const qint64 megabytes = qEnvironmentVariable("MESHVIEWER_DISK_CACHE_SIZE").toLongLong(&ok);
+    if (ok && megabytes > 0)
+        setMaxSize(megabytes * 1024 * 1024);
+    setEnabled(true);
+}
+
+QString DiskCache::subsetKey(const Mesh::Subset *subset)
+{
+    // Not hashed before its file changed, there is nothing to key it by
+    const QByteArray contentHash = subset->contentHash();
+    if (contentHash.isEmpty())
+        return QString();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(contentHash);
+    hash.addData(viewerVersion());
+    hash.addData(QByteArray::number(formatVersion));
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+DiskCache::Record DiskCache::load(const QString &key)
+{
+    Record record;
+    if (!isEnabled() || key.isEmpty())
+        return record;
+
+    auto file = QSharedPointer<QFile>::create(filePath(key));
+    if (!file->open(QIODevice::ReadOnly))
+        return record;
+    TraceSpan span("load disk cache");
+
+    const qint64 size = file->size();
+    const uchar *data = size >= qint64(sizeof(FileHeader)) ? file->map(0, size) : nullptr;
+    FileHeader header;
+    if (data)
+        std::memcpy(&header, data, sizeof(header));
+
+    const QByteArray version = viewerVersion();
+    const bool valid = data
+            && std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) == 0
+            && header.formatVersion == formatVersion
+            && qstrncmp(header.viewerVersion, version.constData(), sizeof(header.viewerVersion)) == 0
+            && sizeof(FileHeader) + quint64(header.sectionCount) * sizeof(SectionEntry) <= quint64(size);
+    if (!valid) {
+        // Written by another version of the viewer, or damaged
+        file->remove();
+        return record;
+    }
+
+    const SectionEntry *entries = reinterpret_cast<const SectionEntry *>(data + sizeof(FileHeader));
+    for (quint32 i = 0; i < header.sectionCount; ++i) {
+        SectionEntry entry;
+        std::memcpy(&entry, entries + i, sizeof(entry));
+        if (entry.offset > quint64(size) || entry.size > quint64(size) - entry.offset) {
+            file->remove();
+            return Record();
+        }
+        record.m_sections.insert(Record::sectionKey(entry.tag, entry.channel), { entry.offset, entry.size });
+    }
+
+    // The modification time orders the files for eviction
+    file->setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    record.m_data = reinterpret_cast<const char *>(data);
+    record.m_file = file;
+    return record;
+}
+
+void DiskCache::store(const QString &key, const QVector<Section> &sections)
+{
+    {
+        QMutexLocker locker(&state().mutex);
+        if (!state().enabled || key.isEmpty() || state().pendingWrites.contains(key))
+            return;
+        state().pendingWrites.insert(key);
+    }
+
+    state().writer.start([key, sections] {
+        write(key, sections);
+        {
+            QMutexLocker locker(&state().mutex);
+            state().pendingWrites.remove(key);
+        }
+        evict();
+    });
+}
+
+bool DiskCache::mergeRecord(const Record &record, QVector<Section> *sections)
+{
+    if (!record.isValid())
+        return true;
+
+    QSet<quint64> keys;
+    bool added = false;
+    int flagsIndex = -1;
+    for (int i = 0; i < sections->size(); ++i) {
+        const Section &section = sections->at(i);
+        keys.insert(Record::sectionKey(section.tag, section.channel));
+        if (section.tag == DecodedAttributesTag)
+            flagsIndex = i;
+        else if (!record.contains(section.tag, section.channel))
+            added = true;
+    }
+    if (!added)
+        return false;
+
+    // The merged record has the attributes decoded by either of them
+    const QVector<quint32> recordFlags = record.array<quint32>(DecodedAttributesTag);
+    if (flagsIndex >= 0 && recordFlags.size() == 1) {
+        const quint32 flags = *reinterpret_cast<const quint32 *>(sections->at(flagsIndex).data);
+        (*sections)[flagsIndex] = section(DecodedAttributesTag, 0, QVector<quint32>{ flags | recordFlags.first() });
+    }
+
+    // Sections of the record point into its mapping, which the copy in
+    // owner keeps alive until they are written
+    auto owner = std::make_shared<const Record>(record);
+    for (auto it = record.m_sections.cbegin(); it != record.m_sections.cend(); ++it) {
+        if (keys.contains(it.key()))
+            continue;
+        sections->append({ quint32(it.key() >> 32), qint32(quint32(it.key())),
+                           record.m_data + it->offset, qint64(it->size), owner });
+    }
+    return true;
+}
+
+void DiskCache::waitForPendingWrites()
+{
+    state().writer.waitForDone();
+}
+
+void DiskCache::clear()
+{
+    waitForPendingWrites();
+    QDir dir(directory());
+    const QStringList files = dir.entryList({ u"*"_qs + fileSuffix }, QDir::Files);
+    for (const QString &file : files)
+        dir.remove(file);
+}
+
+void DiskCache::write(const QString &key, const QVector<Section> &sections)
+{
+    TraceSpan span("write disk cache");
+    const QString path = filePath(key);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.formatVersion = formatVersion;
+    header.sectionCount = quint32(sections.size());
+    const QByteArray version = viewerVersion();
+    std::memcpy(header.viewerVersion, version.constData(), version.size());
+
+    QVector<SectionEntry> entries;
+    entries.reserve(sections.size());
+    quint64 offset = alignedOffset(sizeof(FileHeader) + sections.size() * sizeof(SectionEntry));
+    for (const Section &section : sections) {
+        entries.append({ section.tag, section.channel, offset, quint64(section.size) });
+        offset = alignedOffset(offset + section.size);
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Could not write disk cache file" << path << file.errorString();
+        return;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(entries.constData()), entries.size() * sizeof(SectionEntry));
+    const char padding[16] = {};
+    for (int i = 0; i < sections.size(); ++i) {
+        file.write(padding, entries.at(i).offset - file.pos());
+        file.write(sections.at(i).data, sections.at(i).size);
+    }
+    if (!file.commit())
+        qWarning() << "Could not write disk cache file" << path << file.errorString();
+}
+
+void DiskCache::evict()
+{
+    const qint64 limit = maxSize();
+    QDir dir(directory());
+    // Least recently used first
+    const QFileInfoList files = dir.entryInfoList({ u"*"_qs + fileSuffix }, QDir::Files,
+                                                  QDir::Time | QDir::Reversed);
+    qint64 total = 0;
+    for (const QFileInfo &file : files)
+        total += file.size();
+
+    for (const QFileInfo &file : files) {
+        if (total <= limit)
+            break;
+        if (dir.remove(file.fileName()))
+            total -= file.size();
+    }
+}
+
+QVector<DiskCache::Section> DiskCache::subsetSections(const Mesh::Subset *subset)
+{
+    QVector<Section> sections;
+    const quint32 decoded = subset->m_decodedAttributes;
+    sections.append(section(DecodedAttributesTag, 0, QVector<quint32>{ decoded }));
+
+    if (decoded & Mesh::Subset::PositionsDecoded)
+        sections.append(section(Mesh::PositionSemantic, 0, subset->m_positions));
+    if (decoded & Mesh::Subset::NormalsDecoded)
+        sections.append(section(Mesh::NormalSemantic, 0, subset->m_normals));
+    if (decoded & Mesh::Subset::UVsDecoded)
+        appendChannels(&sections, Mesh::TexCoordSemantic, subset->m_uvs);
+    if (decoded & Mesh::Subset::TangentsDecoded)
+        sections.append(section(Mesh::TangentSemantic, 0, subset->m_tangents));
+    if (decoded & Mesh::Subset::BinormalsDecoded)
+        sections.append(section(Mesh::BinormalSemantic, 0, subset->m_binormals));
+    if (decoded & Mesh::Subset::ColorsDecoded)
+        sections.append(section(Mesh::ColorSemantic, 0, subset->m_colors));
+    if (decoded & Mesh::Subset::JointsDecoded)
+        sections.append(section(Mesh::JointSemantic, 0, subset->m_joints));
+    if (decoded & Mesh::Subset::WeightsDecoded)
+        sections.append(section(Mesh::WeightSemantic, 0, subset->m_weights));
+    if (decoded & Mesh::Subset::MorphTargetPositionsDecoded)
+        appendChannels(&sections, Mesh::MorphTargetPositionSemantic, subset->m_morphTargetPositions);
+    if (decoded & Mesh::Subset::MorphTargetNormalsDecoded)
+        appendChannels(&sections, Mesh::MorphTargetNormalSemantic, subset->m_morphTargetNormals);
+    if (decoded & Mesh::Subset::MorphTargetTangentsDecoded)
+        appendChannels(&sections, Mesh::MorphTargetTangentSemantic, subset->m_morphTargetTangents);
+    if (decoded & Mesh::Subset::MorphTargetBinormalsDecoded)
+        appendChannels(&sections, Mesh::MorphTargetBinormalSemantic, subset->m_morphTargetBinormals);
+    return sections;
+}
+
+void DiskCache::restoreSubset(const Record &record, const Mesh::Subset *subset)
+{
+    const QVector<quint32> flags = record.array<quint32>(DecodedAttributesTag);
+    if (flags.size() != 1)
+        return;
+    TraceSpan span("restore subset attributes");
+
+    // Attributes that are already decoded are left alone
+    const quint32 decoded = flags.first() & ~subset->m_decodedAttributes;
+    const int count = subset->m_count;
+    auto restore = [subset](quint32 attribute, bool restored) {
+        if (restored)
+            subset->m_decodedAttributes |= attribute;
+    };
+    if (decoded & Mesh::Subset::PositionsDecoded)
+        restore(Mesh::Subset::PositionsDecoded, restoreArray(record, Mesh::PositionSemantic, count, &subset->m_positions));
+    if (decoded & Mesh::Subset::NormalsDecoded)
+        restore(Mesh::Subset::NormalsDecoded, restoreArray(record, Mesh::NormalSemantic, count, &subset->m_normals));
+    if (decoded & Mesh::Subset::UVsDecoded)
+        restore(Mesh::Subset::UVsDecoded, restoreChannels(record, Mesh::TexCoordSemantic, count, &subset->m_uvs));
+    if (decoded & Mesh::Subset::TangentsDecoded)
+        restore(Mesh::Subset::TangentsDecoded, restoreArray(record, Mesh::TangentSemantic, count, &subset->m_tangents));
+    if (decoded & Mesh::Subset::BinormalsDecoded)
+        restore(Mesh::Subset::BinormalsDecoded, restoreArray(record, Mesh::BinormalSemantic, count, &subset->m_binormals));
+    if (decoded & Mesh::Subset::ColorsDecoded)
+        restore(Mesh::Subset::ColorsDecoded, restoreArray(record, Mesh::ColorSemantic, count, &subset->m_colors));
+    if (decoded & Mesh::Subset::JointsDecoded)
+        restore(Mesh::Subset::JointsDecoded, restoreArray(record, Mesh::JointSemantic, count, &subset->m_joints));
+    if (decoded & Mesh::Subset::WeightsDecoded)
+        restore(Mesh::Subset::WeightsDecoded, restoreArray(record, Mesh::WeightSemantic, count, &subset->m_weights));
+    if (decoded & Mesh::Subset::MorphTargetPositionsDecoded)
+        restore(Mesh::Subset::MorphTargetPositionsDecoded,
+                restoreChannels(record, Mesh::MorphTargetPositionSemantic, count, &subset->m_morphTargetPositions));
+    if (decoded & Mesh::Subset::MorphTargetNormalsDecoded)
+        restore(Mesh::Subset::MorphTargetNormalsDecoded,
+                restoreChannels(record, Mesh::MorphTargetNormalSemantic, count, &subset->m_morphTargetNormals));
+    if (decoded & Mesh::Subset::MorphTargetTangentsDecoded)
+        restore(Mesh::Subset::MorphTargetTangentsDecoded,
+                restoreChannels(record, Mesh::MorphTargetTangentSemantic, count, &subset->m_morphTargetTangents));
+    if (decoded & Mesh::Subset::MorphTargetBinormalsDecoded)
+        restore(Mesh::Subset::MorphTargetBinormalsDecoded,
+                restoreChannels(record, Mesh::MorphTargetBinormalSemantic, count, &subset->m_morphTargetBinormals));
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2023 Andy Nichols <nezticle@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+
+#include <QByteArray>
+#include <QMap>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+#include <cstring>
+#include <memory>
+
+#include "mesh.h"
+
+class QFile;
+
+// Keeps decoded subset attributes and generated overlay geometry on disk
+// between sessions. Each subset is one file in the cache directory, a table
+// of sections followed by the arrays themselves, so a reopened mesh copies
+// its data out of the mapped file instead of decoding it again. Files are
+// keyed by the content of the mesh and the viewer version, the least
+// recently used ones are removed once the cache grows past maxSize().
+class DiskCache
+{
+public:
+    enum Tag : quint32 {
+        // Tags 1 to 12 hold attribute arrays, by Mesh::AttributeSemantic
+        DecodedAttributesTag = 0,
+        OverlayInfoTag = 0x100,
+        OverlayVertexTag,
+        OverlayIndexTag
+    };
+
+    // One array to store, owner keeps data alive until it is written
+    struct Section {
+        quint32 tag = 0;
+        qint32 channel = 0;
+        const char *data = nullptr;
+        qint64 size = 0;
+        std::shared_ptr<const void> owner;
+    };
+
+    template <typename T>
+    static Section section(quint32 tag, qint32 channel, const QVector<T> &values)
+    {
+        auto owner = std::make_shared<const QVector<T>>(values);
+        return { tag, channel, reinterpret_cast<const char *>(owner->constData()),
+                 qint64(owner->size()) * qint64(sizeof(T)), owner };
+    }
+    static Section section(quint32 tag, qint32 channel, const QByteArray &bytes);
+
+    // A mapped cache file, the data stays valid while a copy of the record exists
+    class Record
+    {
+    public:
+        bool isValid() const { return !m_file.isNull(); }
+        bool contains(quint32 tag, qint32 channel = 0) const;
+        QVector<qint32> channels(quint32 tag) const;
+
+        QByteArray bytes(quint32 tag, qint32 channel = 0) const;
+        template <typename T>
+        QVector<T> array(quint32 tag, qint32 channel = 0) const
+        {
+            QVector<T> values;
+            const auto it = m_sections.constFind(sectionKey(tag, channel));
+            if (it == m_sections.cend() || it->size % sizeof(T))
+                return values;
+            values.resize(it->size / sizeof(T));
+            std::memcpy(values.data(), m_data + it->offset, it->size);
+            return values;
+        }
+
+    private:
+        friend class DiskCache;
+        struct Entry {
+            quint64 offset = 0;
+            quint64 size = 0;
+        };
+        static quint64 sectionKey(quint32 tag, qint32 channel) { return (quint64(tag) << 32) | quint32(channel); }
+
+        QSharedPointer<QFile> m_file;
+        const char *m_data = nullptr;
+        QMap<quint64, Entry> m_sections;
+    };
+
+    static bool isEnabled();
+    static void setEnabled(bool enabled);
+    static QString directory();
+    static void setDirectory(const QString &directory);
+    static qint64 maxSize();
+    static void setMaxSize(qint64 maxSize);
+
+    // MESHVIEWER_DISK_CACHE=0 disables the cache, any other value is used
+    // as the directory. MESHVIEWER_DISK_CACHE_SIZE is the limit in megabytes.
+    static void configureFromEnvironment();
+
+    // Key of the subset's cache file, from its content hash and the viewer
+    // version. Empty when the subset has no hash.
+    static QString subsetKey(const Mesh::Subset *subset);
+
+    // An invalid record when there is no usable file for key
+    static Record load(const QString &key);
+    // Writes in the background, a key that is already being written is skipped
+    static void store(const QString &key, const QVector<Section> &sections);
+    // Adds the sections of record that sections lacks, so storing keeps
+    // them. False when record already holds all of sections and storing
+    // would write the same file again.
+    static bool mergeRecord(const Record &record, QVector<Section> *sections);
+    static void waitForPendingWrites();
+    static void clear();
+
+    // The attributes of subset decoded so far, and restoring them from a record
+    static QVector<Section> subsetSections(const Mesh::Subset *subset);
+    static void restoreSubset(const Record &record, const Mesh::Subset *subset);
+
+private:
+    static void write(const QString &key, const QVector<Section> &sections);
+    static void evict();
+};
+
+#endif // DISKCACHE_H
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2023 Andy Nichols <nezticle@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mesh.h"
+#include "syntheticmesh.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <cstdio>
+
+namespace {
+// Plain bytes or a number followed by K, M or G
+qint64 parseSize(QString text)
+{
+    static const QString suffixes = u"KMG"_qs;
+    qint64 multiplier = 1;
+    const int suffix = text.isEmpty() ? -1 : suffixes.indexOf(text.back().toUpper());
+    if (suffix >= 0) {
+        multiplier = qint64(1) << (10 * (suffix + 1));
+        text.chop(1);
+    }
+    bool ok = false;
+    const qint64 size = text.toLongLong(&ok);
+    return ok && size > 0 ? size * multiplier : -1;
+}
+}
+
+// Writes a .mesh file of synthetic meshes with the requested layout and
+// size, the same arguments always produce the same file
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(u"meshviewer-generate"_qs);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(u"Generates .mesh files for testing the loader at any scale."_qs);
+    parser.addHelpOption();
+    parser.addPositionalArgument(u"file"_qs, u"The .mesh file to write"_qs);
+    QCommandLineOption verticesOption(u"vertices"_qs, u"Vertexes per mesh."_qs, u"count"_qs, u"4096"_qs);
+    QCommandLineOption sizeOption(u"size"_qs, u"Approximate file size, e.g. 64K, 512M or 4G. Picks the vertexes and meshes needed."_qs, u"size"_qs);
+    QCommandLineOption meshesOption(u"meshes"_qs, u"Number of meshes in the file."_qs, u"count"_qs, u"1"_qs);
+    QCommandLineOption subsetsOption(u"subsets"_qs, u"Subsets per mesh."_qs, u"count"_qs, u"1"_qs);
+    QCommandLineOption indexWidthOption(u"index-width"_qs, u"16 or 32 bit indexes."_qs, u"bits"_qs, u"32"_qs);
+    QCommandLineOption uvChannelsOption(u"uv-channels"_qs, u"Number of UV channels."_qs, u"count"_qs, u"1"_qs);
+    QCommandLineOption noNormalsOption(u"no-normals"_qs, u"Leave out normals."_qs);
+    QCommandLineOption noTangentsOption(u"no-tangents"_qs, u"Leave out tangents and binormals."_qs);
+    QCommandLineOption colorsOption(u"colors"_qs, u"Add vertex colors."_qs);
+    QCommandLineOption jointsOption(u"joints"_qs, u"Add joints and weights, with a table of this many joints."_qs, u"count"_qs, u"0"_qs);
+    QCommandLineOption morphTargetsOption(u"morph-targets"_qs, u"Number of morph targets."_qs, u"count"_qs, u"0"_qs);
+    parser.addOptions({ verticesOption, sizeOption, meshesOption, subsetsOption, indexWidthOption,
+                        uvChannelsOption, noNormalsOption, noTangentsOption, colorsOption,
+                        jointsOption, morphTargetsOption });
+    parser.process(app);
+
+    if (parser.positionalArguments().count() != 1)
+        parser.showHelp(2);
+    const QString meshFile = parser.positionalArguments().first();
+
+    SyntheticMesh::Options options;
+    options.vertexCount = parser.value(verticesOption).toUInt();
+    options.subsetCount = parser.value(subsetsOption).toUInt();
+    options.indexType = parser.value(indexWidthOption) == u"16"_qs ? Mesh::UnsignedInt16 : Mesh::UnsignedInt32;
+    options.uvChannels = qMax(0, parser.value(uvChannelsOption).toInt());
+    options.normals = !parser.isSet(noNormalsOption);
+    options.tangents = !parser.isSet(noTangentsOption);
+    options.colors = parser.isSet(colorsOption);
+    options.jointCount = parser.value(jointsOption).toUInt();
+    options.morphTargets = qMax(0, parser.value(morphTargetsOption).toInt());
+    int meshCount = qMax(1, parser.value(meshesOption).toInt());
+
+    if (parser.isSet(sizeOption)) {
+        const qint64 size = parseSize(parser.value(sizeOption));
+        if (size < 0) {
+            fprintf(stderr, "Invalid size: %s\n", qPrintable(parser.value(sizeOption)));
+            return 2;
+        }
+        // Meshes are kept to 256MB so memory use stays bounded for any file size
+        static const qint64 maxMeshSize = 256 * 1024 * 1024;
+        const qint64 bytesPerVertex = SyntheticMesh::bytesPerVertex(options);
+        qint64 maxVertexes = maxMeshSize / bytesPerVertex;
+        if (options.indexType == Mesh::UnsignedInt16)
+            maxVertexes = qMin(maxVertexes, qint64(65536));
+        const qint64 vertexes = qMax(qint64(4), size / bytesPerVertex);
+        meshCount = qMax(qint64(meshCount), (vertexes + maxVertexes - 1) / maxVertexes);
+        options.vertexCount = quint32(vertexes / meshCount);
+    }
+
+    // Every entry has the same content, one mesh is written as often as needed
+    QScopedPointer<Mesh> mesh(SyntheticMesh::create(options));
+    MeshFileTool meshFileTool;
+    if (!meshFileTool.saveMeshFile(meshFile, QVector<Mesh *>(meshCount, mesh.data()))) {
+        fprintf(stderr, "Failed to write %s\n", qPrintable(meshFile));
+        return 1;
+    }
+
+    // Reading the tables back also checks that the file parses
+    const QVector<MeshSummary> summaries = meshFileTool.statMeshFile(meshFile);
+    if (summaries.count() != meshCount) {
+        fprintf(stderr, "Failed to read back %s\n", qPrintable(meshFile));
+        return 1;
+    }
+
+    const QJsonObject result {
+        { u"file"_qs, meshFile },
+        { u"bytes"_qs, QFileInfo(meshFile).size() },
+        { u"meshes"_qs, meshCount },
+        { u"verticesPerMesh"_qs, qint64(summaries.first().vertexCount()) },
+        { u"indexesPerMesh"_qs, qint64(summaries.first().indexCount()) },
+        { u"subsetsPerMesh"_qs, summaries.first().subsets.count() },
+        { u"stride"_qs, qint64(summaries.first().stride) }
+    };
+    const QByteArray json = QJsonDocument(result).toJson(QJsonDocument::Compact);
+    fprintf(stdout, "%s\n", json.constData());
+    return 0;
+}
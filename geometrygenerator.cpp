@@ -25,11 +25,293 @@
  */
 
 #include "geometrygenerator.h"
+#include "diskcache.h"
+#include "tracing.h"
+
+#include <QDataStream>
+#include <QFloat16>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QSet>
+#include <QThread>
+#include <QtMath>
+#include <cstddef>
+#include <numeric>
+
+namespace {
+// A whole interleaved vertex, compared bitwise
+struct VertexKey {
+    const char *data;
+    quint32 size;
+
+    friend bool operator==(const VertexKey &a, const VertexKey &b) {
+        return memcmp(a.data, b.data, a.size) == 0;
+    }
+    friend size_t qHash(const VertexKey &key, size_t seed = 0) {
+        return qHashBits(key.data, key.size, seed);
+    }
+};
+
+struct WeldedVertexes {
+    // Index of the first occurrence of every welded vertex
+    QVector<quint32> unique;
+    // Welded index of every vertex
+    QVector<quint32> indexes;
+};
+
+const int chunkSize = 64 * 1024;
+const qsizetype maxScratchBufferSize = 64 * 1024 * 1024;
+// Glyphs drawn by one model, the lines of a chunk are 1.5MB
+const int glyphsPerChunk = 65536;
+
+// Merges the bitwise identical vertexes of a triangle soup. Chunks are
+// welded on their own in parallel, then their unique vertexes are merged
+// into one table and the indexes remapped.
+WeldedVertexes weldVertexes(const char *vertexes, quint32 stride, int count)
+{
+    struct Chunk {
+        int begin = 0;
+        int end = 0;
+        // First occurrence of each vertex unique within the chunk
+        QVector<quint32> unique;
+        // Index into unique for every vertex of the chunk
+        QVector<quint32> localIndexes;
+        // Welded index for every entry of unique
+        QVector<quint32> globalIndexes;
+    };
+
+    WeldedVertexes welded;
+    if (count == 0 || stride == 0)
+        return welded;
+
+    QVector<Chunk> chunks((count + chunkSize - 1) / chunkSize);
+    for (int i = 0; i < chunks.count(); ++i) {
+        chunks[i].begin = i * chunkSize;
+        chunks[i].end = qMin(count, (i + 1) * chunkSize);
+    }
+
+    QtConcurrent::blockingMap(chunks, [vertexes, stride](Chunk &chunk) {
+        QHash<VertexKey, quint32> table;
+        table.reserve(chunk.end - chunk.begin);
+        chunk.localIndexes.resize(chunk.end - chunk.begin);
+        for (int i = chunk.begin; i < chunk.end; ++i) {
+            const VertexKey key { vertexes + qsizetype(i) * stride, stride };
+            auto it = table.constFind(key);
+            if (it == table.cend()) {
+                it = table.insert(key, quint32(chunk.unique.count()));
+                chunk.unique.append(quint32(i));
+            }
+            chunk.localIndexes[i - chunk.begin] = *it;
+        }
+    });
+
+    // Merging only touches the vertexes that are unique within their chunk
+    QHash<VertexKey, quint32> table;
+    table.reserve(chunks.first().unique.count());
+    for (Chunk &chunk : chunks) {
+        chunk.globalIndexes.resize(chunk.unique.count());
+        for (int i = 0; i < chunk.unique.count(); ++i) {
+            const VertexKey key { vertexes + qsizetype(chunk.unique.at(i)) * stride, stride };
+            auto it = table.constFind(key);
+            if (it == table.cend()) {
+                it = table.insert(key, quint32(welded.unique.count()));
+                welded.unique.append(chunk.unique.at(i));
+            }
+            chunk.globalIndexes[i] = *it;
+        }
+    }
+
+    welded.indexes.resize(count);
+    quint32 *indexes = welded.indexes.data();
+    QtConcurrent::blockingMap(chunks, [indexes](const Chunk &chunk) {
+        for (int i = chunk.begin; i < chunk.end; ++i)
+            indexes[i] = chunk.globalIndexes.at(chunk.localIndexes.at(i - chunk.begin));
+    });
+    return welded;
+}
+
+// The edges of all triangles, every edge once as a pair of indexes.
+// Triangles are split into chunks in parallel, each chunk sorting its edges
+// into partitions by hash, then every partition is deduplicated on its own.
+QVector<quint32> uniqueEdges(const QVector<quint32> &indexes)
+{
+    const int triangleCount = indexes.count() / 3;
+    const int chunkCount = qMax(1, (triangleCount + chunkSize - 1) / chunkSize);
+    const int partitionCount = chunkCount > 1 ? qMax(1, QThread::idealThreadCount()) : 1;
+
+    // Edge keys of every chunk, by partition
+    QVector<QVector<QVector<quint64>>> chunks(chunkCount);
+    for (auto &chunk : chunks)
+        chunk.resize(partitionCount);
+    QVector<int> chunkIndexes(chunkCount);
+    std::iota(chunkIndexes.begin(), chunkIndexes.end(), 0);
+    QtConcurrent::blockingMap(chunkIndexes, [&](int chunkIndex) {
+        auto &partitions = chunks[chunkIndex];
+        const int end = qMin(triangleCount, (chunkIndex + 1) * chunkSize);
+        for (int triangle = chunkIndex * chunkSize; triangle < end; ++triangle) {
+            const quint32 *corners = indexes.constData() + 3 * triangle;
+            for (int corner = 0; corner < 3; ++corner) {
+                const quint32 a = corners[corner];
+                const quint32 b = corners[(corner + 1) % 3];
+                if (a == b)
+                    continue;
+                const quint64 key = (quint64(qMin(a, b)) << 32) | qMax(a, b);
+                partitions[qHash(key) % partitionCount].append(key);
+            }
+        }
+    });
+
+    QVector<QVector<quint64>> partitions(partitionCount);
+    QVector<int> partitionIndexes(partitionCount);
+    std::iota(partitionIndexes.begin(), partitionIndexes.end(), 0);
+    QtConcurrent::blockingMap(partitionIndexes, [&](int partitionIndex) {
+        QSet<quint64> seen;
+        auto &edges = partitions[partitionIndex];
+        for (const auto &chunk : std::as_const(chunks)) {
+            for (quint64 key : chunk.at(partitionIndex)) {
+                if (!seen.contains(key)) {
+                    seen.insert(key);
+                    edges.append(key);
+                }
+            }
+        }
+    });
+
+    QVector<quint32> edgeIndexes;
+    for (const auto &edges : std::as_const(partitions)) {
+        for (quint64 key : edges) {
+            edgeIndexes.append(quint32(key >> 32));
+            edgeIndexes.append(quint32(key));
+        }
+    }
+    return edgeIndexes;
+}
+
+// 16 bit indexes when every vertex can be addressed with them
+QByteArray packIndexes(const QVector<quint32> &indexes, int vertexCount,
+                       QQuick3DGeometry::Attribute::ComponentType *indexType)
+{
+    QByteArray indexData;
+    if (vertexCount <= std::numeric_limits<quint16>::max() + 1) {
+        *indexType = QQuick3DGeometry::Attribute::U16Type;
+        indexData.resize(indexes.count() * qsizetype(sizeof(quint16)));
+        quint16 *ip = reinterpret_cast<quint16 *>(indexData.data());
+        for (quint32 index : indexes)
+            *ip++ = quint16(index);
+    } else {
+        *indexType = QQuick3DGeometry::Attribute::U32Type;
+        indexData = QByteArray(reinterpret_cast<const char *>(indexes.constData()),
+                               indexes.count() * qsizetype(sizeof(quint32)));
+    }
+    return indexData;
+}
+
+// One vertex of the compact layout, see GeometryGenerator::compactPreview.
+// Every payload is an integer below 2^24, stored as its float value.
+struct CompactVertex {
+    // x | r << 16, y | g << 16, z | b << 16
+    float positionColor[3];
+    // u | a << 16, v, normal as GlyphTexture::packDirection
+    float uvNormal[3];
+};
+static_assert(sizeof(CompactVertex) == 24, "CompactVertex must be tightly packed");
+
+float packPair(quint16 low, quint8 high)
+{
+    return float(quint32(low) | quint32(high) << 16);
+}
+
+quint16 toUnorm16(float value, float min, float extent)
+{
+    if (extent <= 0.0f)
+        return 0;
+    return quint16(qRound(qBound(0.0f, (value - min) / extent, 1.0f) * 65535.0f));
+}
+
+float fromUnorm16(quint16 value, float min, float extent)
+{
+    return min + value / 65535.0f * extent;
+}
+
+quint16 toHalf(float value)
+{
+    const qfloat16 half(value);
+    quint16 bits;
+    memcpy(&bits, &half, sizeof(bits));
+    return bits;
+}
+
+float fromHalf(quint16 bits)
+{
+    qfloat16 half;
+    memcpy(&half, &bits, sizeof(bits));
+    return float(half);
+}
+
+quint8 toUnorm8(float value)
+{
+    return quint8(qRound(qBound(0.0f, value, 1.0f) * 255.0f));
+}
+
+// The positions are quantized to their own bounds, the bounds stored in
+// the mesh are not trusted to contain them
+void positionBounds(const QVector<QVector3D> &positions, QVector3D *min, QVector3D *max)
+{
+    if (positions.isEmpty()) {
+        *min = *max = QVector3D();
+        return;
+    }
+    *min = *max = positions.first();
+    for (const QVector3D &position : positions) {
+        *min = QVector3D(qMin(min->x(), position.x()), qMin(min->y(), position.y()), qMin(min->z(), position.z()));
+        *max = QVector3D(qMax(max->x(), position.x()), qMax(max->y(), position.y()), qMax(max->z(), position.z()));
+    }
+}
+
+// Angle between an original direction and its decoded one, zero vectors
+// only have to stay zero
+float directionError(const QVector3D &original, const QVector3D &decoded)
+{
+    if (qFuzzyIsNull(original.lengthSquared()))
+        return decoded.isNull() ? 0.0f : 180.0f;
+    const float cosine = qBound(-1.0f, QVector3D::dotProduct(original.normalized(), decoded), 1.0f);
+    return qRadiansToDegrees(std::acos(cosine));
+}
+}
 
 GeometryGenerator::GeometryGenerator(QQuick3DObject *parent)
     : QQuick3DObject(parent)
 {
+    m_cache.setMaxCost(256 * 1024 * 1024);
 
+    // The geometry objects live as long as the generator and are updated in
+    // place, the models using them are not bound again for every subset
+    m_originalGeometry = new QQuick3DGeometry(this);
+    m_wireframeGeometry = new QQuick3DGeometry(this);
+    m_normalsTexture = new GlyphTexture(this);
+    m_tangentsTexture = new GlyphTexture(this);
+    m_binormalsTexture = new GlyphTexture(this);
+
+    // One line per glyph of a chunk, VERTEX is the glyph within the chunk
+    // and the end of the line. GlyphMaterial looks the glyph up in the
+    // texture, so the geometry is the same for every chunk and subset.
+    QByteArray glyphVertexes(glyphsPerChunk * 2 * 3 * qsizetype(sizeof(float)), Qt::Uninitialized);
+    float *vertex = reinterpret_cast<float *>(glyphVertexes.data());
+    for (int i = 0; i < glyphsPerChunk; ++i) {
+        for (float end : { 0.0f, 1.0f }) {
+            *vertex++ = float(i);
+            *vertex++ = end;
+            *vertex++ = 0.0f;
+        }
+    }
+    m_glyphGeometry = new QQuick3DGeometry(this);
+    m_glyphGeometry->setStride(3 * sizeof(float));
+    m_glyphGeometry->setPrimitiveType(QQuick3DGeometry::PrimitiveType::Lines);
+    m_glyphGeometry->addAttribute(QQuick3DGeometry::Attribute::PositionSemantic,
+                                  0,
+                                  QQuick3DGeometry::Attribute::F32Type);
+    m_glyphGeometry->setVertexData(glyphVertexes);
 }
 
 void GeometryGenerator::setSubset(Mesh::Subset *subset)
@@ -43,27 +325,240 @@ void GeometryGenerator::setSubset(Mesh::Subset *subset)
 
 QQuick3DGeometry *GeometryGenerator::original() const
 {
-    return m_originalGeometry;
+    return isPublished(OriginalGeometry) ? m_originalGeometry : nullptr;
 }
 
 QQuick3DGeometry *GeometryGenerator::wireframe() const
 {
-    return m_wireframeGeometry;
+    return isPublished(WireframeGeometry) ? m_wireframeGeometry : nullptr;
+}
+
+QQuick3DGeometry *GeometryGenerator::glyph() const
+{
+    return m_glyphGeometry;
+}
+
+int GeometryGenerator::glyphChunkSize() const
+{
+    return glyphsPerChunk;
+}
+
+GlyphTexture *GeometryGenerator::normals() const
+{
+    return isPublished(NormalGeometry) ? m_normalsTexture : nullptr;
+}
+
+GlyphTexture *GeometryGenerator::tangents() const
+{
+    return isPublished(TangentGeometry) ? m_tangentsTexture : nullptr;
+}
+
+GlyphTexture *GeometryGenerator::binormals() const
+{
+    return isPublished(BinormalGeometry) ? m_binormalsTexture : nullptr;
+}
+
+float GeometryGenerator::glyphLength() const
+{
+    return m_scaleFactor * m_glyphScale;
+}
+
+float GeometryGenerator::glyphScale() const
+{
+    return m_glyphScale;
+}
+
+void GeometryGenerator::setGlyphScale(float glyphScale)
+{
+    if (qFuzzyCompare(m_glyphScale, glyphScale))
+        return;
+
+    m_glyphScale = glyphScale;
+    emit glyphScaleChanged(m_glyphScale);
+    updateGlyphLength();
+}
+
+bool GeometryGenerator::compactPreview() const
+{
+    return m_compactPreview;
+}
+
+void GeometryGenerator::setCompactPreview(bool compactPreview)
+{
+    if (m_compactPreview == compactPreview)
+        return;
+
+    m_compactPreview = compactPreview;
+    emit compactPreviewChanged(m_compactPreview);
+    updateOverlay(OriginalGeometry);
+}
+
+bool GeometryGenerator::originalCompact() const
+{
+    return m_originalCompact;
+}
+
+QVector3D GeometryGenerator::originalBoundsMin() const
+{
+    return m_originalBoundsMin;
+}
+
+QVector3D GeometryGenerator::originalBoundsMax() const
+{
+    return m_originalBoundsMax;
+}
+
+QVariantMap GeometryGenerator::precisionReport() const
+{
+    if (!m_originalCompact || !isPublished(OriginalGeometry) || !m_subset)
+        return QVariantMap();
+
+    // The subset is decoded already, measuring is one pass over it
+    if (m_precisionSubset != m_subset->cacheKey()) {
+        m_precisionReport = measureCompactPrecision(subsetData());
+        m_precisionSubset = m_subset->cacheKey();
+    }
+    return m_precisionReport;
+}
+
+void GeometryGenerator::updateGlyphLength()
+{
+    emit glyphLengthChanged(glyphLength());
+    updateGlyphBounds();
+}
+
+void GeometryGenerator::updateGlyphBounds()
+{
+    // The glyph geometry is in glyph indexes, culling needs the extents of
+    // the glyphs the material places
+    const QVector3D margin(glyphLength(), glyphLength(), glyphLength());
+    m_glyphGeometry->setBounds(m_originalBoundsMin - margin, m_originalBoundsMax + margin);
+    m_glyphGeometry->update();
+}
+
+qint64 GeometryGenerator::cacheHits() const
+{
+    return m_cacheHits;
+}
+
+qint64 GeometryGenerator::cacheMisses() const
+{
+    return m_cacheMisses;
+}
+
+qint64 GeometryGenerator::cacheSize() const
+{
+    return m_cache.totalCost();
+}
+
+qint64 GeometryGenerator::maxCacheSize() const
+{
+    return m_cache.maxCost();
+}
+
+qint64 GeometryGenerator::diskCacheHits() const
+{
+    return m_diskCacheHits;
+}
+
+bool GeometryGenerator::wireframeEnabled() const
+{
+    return m_wireframeEnabled;
+}
+
+bool GeometryGenerator::normalsEnabled() const
+{
+    return m_normalsEnabled;
+}
+
+bool GeometryGenerator::tangentsEnabled() const
+{
+    return m_tangentsEnabled;
+}
+
+bool GeometryGenerator::binormalsEnabled() const
+{
+    return m_binormalsEnabled;
+}
+
+bool GeometryGenerator::hasTangents() const
+{
+    return m_subset && m_subset->drawMode() == Mesh::DrawMode::Triangles
+            && m_subset->hasAttribute(Mesh::TangentSemantic);
+}
+
+bool GeometryGenerator::hasBinormals() const
+{
+    return m_subset && m_subset->drawMode() == Mesh::DrawMode::Triangles
+            && m_subset->hasAttribute(Mesh::BinormalSemantic);
+}
+
+void GeometryGenerator::setWireframeEnabled(bool wireframeEnabled)
+{
+    if (m_wireframeEnabled == wireframeEnabled)
+        return;
+
+    m_wireframeEnabled = wireframeEnabled;
+    emit wireframeEnabledChanged(m_wireframeEnabled);
+    updateOverlay(WireframeGeometry);
+}
+
+void GeometryGenerator::setNormalsEnabled(bool normalsEnabled)
+{
+    if (m_normalsEnabled == normalsEnabled)
+        return;
+
+    m_normalsEnabled = normalsEnabled;
+    emit normalsEnabledChanged(m_normalsEnabled);
+    updateOverlay(NormalGeometry);
+}
+
+void GeometryGenerator::setTangentsEnabled(bool tangentsEnabled)
+{
+    if (m_tangentsEnabled == tangentsEnabled)
+        return;
+
+    m_tangentsEnabled = tangentsEnabled;
+    emit tangentsEnabledChanged(m_tangentsEnabled);
+    updateOverlay(TangentGeometry);
+}
+
+void GeometryGenerator::setBinormalsEnabled(bool binormalsEnabled)
+{
+    if (m_binormalsEnabled == binormalsEnabled)
+        return;
+
+    m_binormalsEnabled = binormalsEnabled;
+    emit binormalsEnabledChanged(m_binormalsEnabled);
+    updateOverlay(BinormalGeometry);
 }
 
-QQuick3DGeometry *GeometryGenerator::normals() const
+int GeometryGenerator::sourceVertexCount() const
 {
-    return m_normalsLinesGeometry;
+    return m_sourceVertexCount;
 }
 
-QQuick3DGeometry *GeometryGenerator::tangents() const
+int GeometryGenerator::weldedVertexCount() const
 {
-    return m_tangetsLinesGeometry;
+    if (!isPublished(OriginalGeometry) || m_originalGeometry->stride() == 0)
+        return 0;
+    return m_originalGeometry->vertexData().size() / m_originalGeometry->stride();
 }
 
-QQuick3DGeometry *GeometryGenerator::binormals() const
+void GeometryGenerator::setMaxCacheSize(qint64 maxCacheSize)
 {
-    return m_binormalsLinesGeometry;
+    if (m_cache.maxCost() == maxCacheSize)
+        return;
+
+    m_cache.setMaxCost(maxCacheSize);
+    emit maxCacheSizeChanged(maxCacheSize);
+    emit cacheStatisticsChanged();
+}
+
+void GeometryGenerator::clearCache()
+{
+    m_cache.clear();
+    emit cacheStatisticsChanged();
 }
 
 MeshInfo *GeometryGenerator::meshInfo() const
@@ -81,19 +576,38 @@ float GeometryGenerator::scaleFactor() const
     return m_scaleFactor;
 }
 
+qint64 GeometryGenerator::geometryBytes() const
+{
+    qint64 bytes = 0;
+    for (const QQuick3DGeometry *geometry : { m_originalGeometry, m_wireframeGeometry })
+        bytes += geometry->vertexData().size() + geometry->indexData().size();
+    for (const GlyphTexture *texture : { m_normalsTexture, m_tangentsTexture, m_binormalsTexture })
+        bytes += texture->records().size();
+    // Shared by the glyphs of every overlay and subset
+    bytes += m_glyphGeometry->vertexData().size();
+    return bytes;
+}
+
 void GeometryGenerator::setMeshInfo(MeshInfo *meshInfo)
 {
     if (m_meshInfo == meshInfo)
         return;
 
-    if (m_meshInfo)
+    if (m_meshInfo) {
+        disconnect(m_meshInfo, &MeshInfo::meshFileChanged, this, &GeometryGenerator::clearCache);
         disconnect(m_meshInfo, &MeshInfo::meshesUpdated, this, &GeometryGenerator::updateSubset);
+    }
 
     m_meshInfo = meshInfo;
     emit meshInfoChanged(m_meshInfo);
+    clearCache();
     updateSubset();
-    if (m_meshInfo)
+    if (m_meshInfo) {
+        // Nothing of the previous file will be shown again. Reloads of the
+        // same file keep the cache, unchanged subsets keep their cache keys.
+        connect(m_meshInfo, &MeshInfo::meshFileChanged, this, &GeometryGenerator::clearCache);
         connect(m_meshInfo, &MeshInfo::meshesUpdated, this, &GeometryGenerator::updateSubset);
+    }
 }
 
 void GeometryGenerator::setSubsetIndex(int subsetIndex)
@@ -126,64 +640,395 @@ void GeometryGenerator::updateSubset()
     m_subset = subset;
     // Update Scale Factor
     // Scale factor is 1/100 of the largest bounds extents
-    const QVector3D extents = m_subset->bounds().max - m_subset->bounds().min;
-    float maxExtent = qMax(qMax(extents.x(), extents.y()), extents.z());
-    m_scaleFactor = maxExtent / 100.0f;
-    emit scaleFactorChanged(m_scaleFactor);
+    if (m_subset) {
+        const QVector3D extents = m_subset->bounds().max - m_subset->bounds().min;
+        float maxExtent = qMax(qMax(extents.x(), extents.y()), extents.z());
+        m_scaleFactor = maxExtent / 100.0f;
+        emit scaleFactorChanged(m_scaleFactor);
+        updateGlyphLength();
+    }
     generate();
 }
 
 void GeometryGenerator::generate()
 {
-    // Cleanup any old geometry
-    if (m_originalGeometry)
-        delete m_originalGeometry;
-    if (m_wireframeGeometry)
-        delete m_wireframeGeometry;
-    if (m_normalsLinesGeometry)
-        delete m_normalsLinesGeometry;
-    if (m_tangetsLinesGeometry)
-        delete m_tangetsLinesGeometry;
-    if (m_binormalsLinesGeometry)
-        delete m_binormalsLinesGeometry;
-
-    if (!m_subset)
+    ++m_generation;
+    requestGeometries({ OriginalGeometry, WireframeGeometry, NormalGeometry, TangentGeometry, BinormalGeometry });
+}
+
+void GeometryGenerator::updateOverlay(GeometryKind kind)
+{
+    // Picked up once the geometries of the subset are published
+    if (m_pendingGeneration == m_generation)
         return;
 
-    if (m_subset->drawMode() != Mesh::DrawMode::Triangles)
+    requestGeometries({ kind });
+}
+
+void GeometryGenerator::requestGeometries(const QVector<GeometryKind> &kinds)
+{
+    GenerateJob job;
+    job.generation = m_generation;
+    job.kinds = kinds;
+    const bool triangles = m_subset && m_subset->drawMode() == Mesh::DrawMode::Triangles;
+    job.sourceVertexCount = triangles ? m_subset->count() : 0;
+    job.compact = m_compactPreview;
+    for (GeometryKind kind : kinds) {
+        if (!triangles || !isEnabled(kind))
+            continue;
+        job.enabled.append(kind);
+        if (const GeometryData *data = m_cache.object({ m_subset->cacheKey(), cacheSlot(kind, job.compact) })) {
+            ++m_cacheHits;
+            job.geometries[kind] = *data;
+        } else {
+            ++m_cacheMisses;
+            job.missing.append(kind);
+        }
+    }
+
+    if (job.missing.isEmpty()) {
+        publishGeometries(job);
         return;
+    }
+    if (job.kinds.contains(OriginalGeometry))
+        m_pendingGeneration = job.generation;
+
+    // The subset is decoded, and the disk cache read and written, by the
+    // job on a copy of the subset, only the results come back here
+    const QSharedPointer<Mesh> mesh(m_subset->sharedCopy());
+    auto watcher = new QFutureWatcher<GenerateResult>(this);
+    connect(watcher, &QFutureWatcher<GenerateResult>::finished, this, [this, watcher, job]() mutable {
+        watcher->deleteLater();
+        if (watcher->isCanceled() || job.generation != m_generation)
+            return;
+        if (m_pendingGeneration == job.generation && job.kinds.contains(OriginalGeometry))
+            m_pendingGeneration = 0;
+
+        const GenerateResult result = watcher->result();
+        m_subset->reuseDecodedData(*result.decoded->subsets().first());
+        // Buffers are implicitly shared with the geometry objects, caching costs no copy
+        for (auto it = result.restored.cbegin(); it != result.restored.cend(); ++it) {
+            m_cache.insert({ m_subset->cacheKey(), it.key() }, new GeometryData(it.value()),
+                           qMax(qint64(1), it.value().bytes()));
+        }
+        if (!result.restored.isEmpty())
+            ++m_diskCacheHits;
+        for (int i = 0; i < job.missing.count(); ++i) {
+            const GeometryKind kind = job.missing.at(i);
+            const GeometryData &data = result.geometries.at(i);
+            m_cache.insert({ m_subset->cacheKey(), cacheSlot(kind, job.compact) }, new GeometryData(data),
+                           qMax(qint64(1), data.bytes()));
+            job.geometries[kind] = data;
+        }
+        publishGeometries(job);
 
-    generateOriginalGeometry();
-    generateWireframeGeometry();
-    generateNormalGeometry();
-    generateTangentGeometry();
-    generateBinormalGeometry();
+        // Overlays enabled, or a layout picked, while the job was running
+        for (GeometryKind kind : std::as_const(job.kinds)) {
+            if (isEnabled(kind) && !job.enabled.contains(kind))
+                updateOverlay(kind);
+        }
+        if (job.kinds.contains(OriginalGeometry) && job.compact != m_compactPreview)
+            updateOverlay(OriginalGeometry);
+    });
+    watcher->setFuture(QtConcurrent::run(&GeometryGenerator::runGenerateJob, job, mesh));
+    emit cacheStatisticsChanged();
 }
 
-void GeometryGenerator::generateOriginalGeometry()
+GeometryGenerator::GenerateResult GeometryGenerator::runGenerateJob(const GenerateJob &job, const QSharedPointer<Mesh> &mesh)
 {
-    m_originalGeometry = new QQuick3DGeometry(this);
+    GenerateResult result;
+    result.decoded = mesh;
+    result.geometries.resize(job.missing.count());
+    const Mesh::Subset *subset = mesh->subsets().first();
+
+    // Hashes the subset, a subset that was not hashed before its file
+    // changed is not cached
+    const QString key = DiskCache::isEnabled() ? DiskCache::subsetKey(subset) : QString();
+    if (!key.isEmpty() && job.missing.contains(OriginalGeometry))
+        result.restored = restoreFromDiskCache(DiskCache::load(key), job.compact);
+
+    QVector<int> generated;
+    for (int i = 0; i < job.missing.count(); ++i) {
+        const int slot = cacheSlot(job.missing.at(i), job.compact);
+        if (result.restored.contains(slot))
+            result.geometries[i] = result.restored.value(slot);
+        else
+            generated.append(i);
+    }
+    if (generated.isEmpty())
+        return result;
+
+    // Every missing geometry is generated by its own worker
+    const SubsetData data = subsetData(subset, job.compact);
+    GeometryData *geometries = result.geometries.data();
+    QtConcurrent::blockingMap(generated, [&](int i) {
+        geometries[i] = generateGeometry(job.missing.at(i), data);
+    });
+
+    if (!key.isEmpty()) {
+        QHash<int, GeometryData> stored = result.restored;
+        for (GeometryKind kind : job.enabled) {
+            if (!job.missing.contains(kind))
+                stored.insert(cacheSlot(kind, job.compact), job.geometries.at(kind));
+        }
+        for (int i : std::as_const(generated))
+            stored.insert(cacheSlot(job.missing.at(i), job.compact), result.geometries.at(i));
+        storeToDiskCache(key, subset, stored);
+    }
+    return result;
+}
+
+void GeometryGenerator::publishGeometries(const GenerateJob &job)
+{
+    // All geometries of the job are swapped in at once, the scene is not
+    // synchronized before this returns
+    for (GeometryKind kind : job.kinds) {
+        const bool enabled = isEnabled(kind) && job.sourceVertexCount > 0;
+        setGeometry(kind, enabled ? job.geometries.at(kind) : GeometryData());
+    }
+    if (job.kinds.contains(OriginalGeometry)) {
+        const GeometryData &original = job.geometries.at(OriginalGeometry);
+        m_sourceVertexCount = isPublished(OriginalGeometry) ? job.sourceVertexCount : 0;
+        m_originalCompact = job.compact;
+        m_originalBoundsMin = original.boundsMin;
+        m_originalBoundsMax = original.boundsMax;
+        updateGlyphBounds();
+    }
+    emit geometriesPublished();
+    emit cacheStatisticsChanged();
 
-    const auto &positions = m_subset->positions();
-    const auto &normals = m_subset->normals();
-    const auto &uvs = m_subset->uvs();
-    const auto &tangents = m_subset->tangents();
-    const auto &binormals = m_subset->binormals();
-    const auto &colors = m_subset->colors();
-    const int count = m_subset->count();
+    if (m_meshInfo)
+        m_meshInfo->setOverlayGeometryBytes(geometryBytes());
+}
+
+bool GeometryGenerator::isEnabled(GeometryKind kind) const
+{
+    switch (kind) {
+    case OriginalGeometry:
+        return true;
+    case WireframeGeometry:
+        return m_wireframeEnabled;
+    case NormalGeometry:
+        return m_normalsEnabled;
+    case TangentGeometry:
+        return m_tangentsEnabled;
+    case BinormalGeometry:
+        return m_binormalsEnabled;
+    }
+    return false;
+}
+
+QQuick3DGeometry *GeometryGenerator::geometryObject(GeometryKind kind) const
+{
+    switch (kind) {
+    case OriginalGeometry:
+        return m_originalGeometry;
+    case WireframeGeometry:
+        return m_wireframeGeometry;
+    default:
+        return nullptr;
+    }
+}
+
+GlyphTexture *GeometryGenerator::glyphTexture(GeometryKind kind) const
+{
+    switch (kind) {
+    case NormalGeometry:
+        return m_normalsTexture;
+    case TangentGeometry:
+        return m_tangentsTexture;
+    case BinormalGeometry:
+        return m_binormalsTexture;
+    default:
+        return nullptr;
+    }
+}
+
+bool GeometryGenerator::isPublished(GeometryKind kind) const
+{
+    return m_publishedGeometries & (1 << kind);
+}
+
+void GeometryGenerator::setGeometry(GeometryKind kind, const GeometryData &data)
+{
+    // The buffers are shared with the cache, setting them does not copy
+    if (QQuick3DGeometry *geometry = geometryObject(kind)) {
+        geometry->clear();
+        geometry->setStride(data.stride);
+        geometry->setPrimitiveType(data.primitiveType);
+        geometry->setBounds(data.boundsMin, data.boundsMax);
+        for (const auto &attribute : data.attributes)
+            geometry->addAttribute(attribute.semantic, attribute.offset, attribute.componentType);
+        geometry->setVertexData(data.vertexData);
+        geometry->setIndexData(data.indexData);
+        geometry->update();
+    } else {
+        // The glyph records are kept in the vertex data
+        glyphTexture(kind)->setRecords(data.vertexData);
+    }
+
+    // Overlays that do not apply to the subset have no data and are null
+    // to QML. Only a change of that is signaled.
+    const bool wasPublished = isPublished(kind);
+    const bool published = !data.vertexData.isEmpty();
+    if (published)
+        m_publishedGeometries |= 1 << kind;
+    else
+        m_publishedGeometries &= ~(1 << kind);
+    if (published == wasPublished)
+        return;
+
+    switch (kind) {
+    case OriginalGeometry:
+        emit originalChanged(original());
+        break;
+    case WireframeGeometry:
+        emit wireframeChanged(wireframe());
+        break;
+    case NormalGeometry:
+        emit normalsChanged(normals());
+        break;
+    case TangentGeometry:
+        emit tangentsChanged(tangents());
+        break;
+    case BinormalGeometry:
+        emit binormalsChanged(binormals());
+        break;
+    }
+}
+
+QHash<int, GeometryGenerator::GeometryData> GeometryGenerator::restoreFromDiskCache(const DiskCache::Record &record,
+                                                                                  bool compact)
+{
+    QHash<int, GeometryData> geometries;
+    if (!record.isValid())
+        return geometries;
+
+    // Only the overlays that were enabled, and the layouts of the original
+    // geometry that were shown, when the subset was stored are in the record
+    for (int slot = 0; slot < SlotCount; ++slot) {
+        const QByteArray info = record.bytes(DiskCache::OverlayInfoTag, slot);
+        if (info.isEmpty())
+            continue;
+
+        GeometryData data;
+        QDataStream stream(info);
+        quint32 primitiveType = 0;
+        quint32 attributeCount = 0;
+        stream >> primitiveType >> data.stride >> data.boundsMin >> data.boundsMax >> attributeCount;
+        for (quint32 i = 0; i < attributeCount && stream.status() == QDataStream::Ok; ++i) {
+            quint32 semantic = 0;
+            quint32 offset = 0;
+            quint32 componentType = 0;
+            stream >> semantic >> offset >> componentType;
+            data.attributes.append({ QQuick3DGeometry::Attribute::Semantic(semantic), offset,
+                                     QQuick3DGeometry::Attribute::ComponentType(componentType) });
+        }
+        if (stream.status() != QDataStream::Ok)
+            return QHash<int, GeometryData>();
+        data.primitiveType = QQuick3DGeometry::PrimitiveType(primitiveType);
+        data.vertexData = record.bytes(DiskCache::OverlayVertexTag, slot);
+        data.indexData = record.bytes(DiskCache::OverlayIndexTag, slot);
+        geometries.insert(slot, data);
+    }
+
+    // Only used when every overlay in the record could be read
+    if (!geometries.contains(cacheSlot(OriginalGeometry, compact)))
+        return QHash<int, GeometryData>();
+    return geometries;
+}
+
+void GeometryGenerator::storeToDiskCache(const QString &key, const Mesh::Subset *subset,
+                                         const QHash<int, GeometryData> &geometries)
+{
+    // Whatever attributes of the subset are decoded by now are stored along
+    // with every overlay of the subset the job has
+    QVector<DiskCache::Section> sections = DiskCache::subsetSections(subset);
+    for (int slot = 0; slot < SlotCount; ++slot) {
+        const auto it = geometries.constFind(slot);
+        if (it == geometries.cend())
+            continue;
+        const GeometryData &data = it.value();
+        QByteArray info;
+        QDataStream stream(&info, QIODevice::WriteOnly);
+        stream << quint32(data.primitiveType) << data.stride << data.boundsMin << data.boundsMax
+               << quint32(data.attributes.size());
+        for (const auto &attribute : data.attributes)
+            stream << quint32(attribute.semantic) << attribute.offset << quint32(attribute.componentType);
+        sections.append(DiskCache::section(DiskCache::OverlayInfoTag, slot, info));
+        sections.append(DiskCache::section(DiskCache::OverlayVertexTag, slot, data.vertexData));
+        sections.append(DiskCache::section(DiskCache::OverlayIndexTag, slot, data.indexData));
+    }
+
+    // Only written when something was added since the subset was stored,
+    // the file then keeps what it had, including overlays the job did not
+    // have, and this subset no longer caches
+    if (DiskCache::mergeRecord(DiskCache::load(key), &sections))
+        DiskCache::store(key, sections);
+}
+
+GeometryGenerator::SubsetData GeometryGenerator::subsetData(const Mesh::Subset *subset, bool compact)
+{
+    // Decodes the attributes that are not decoded yet
+    SubsetData data;
+    data.positions = subset->positions();
+    data.normals = subset->normals();
+    data.uvs = subset->uvs();
+    data.tangents = subset->tangents();
+    data.binormals = subset->binormals();
+    data.colors = subset->colors();
+    data.count = subset->count();
+    data.boundsMin = subset->bounds().min;
+    data.boundsMax = subset->bounds().max;
+    data.compact = compact;
+    return data;
+}
+
+GeometryGenerator::GeometryData GeometryGenerator::generateGeometry(GeometryKind kind, const SubsetData &subset)
+{
+    switch (kind) {
+    case OriginalGeometry:
+        return generateOriginalGeometry(subset);
+    case WireframeGeometry:
+        return generateWireframeGeometry(subset);
+    case NormalGeometry:
+        return generateNormalGeometry(subset);
+    case TangentGeometry:
+        return generateTangentGeometry(subset);
+    case BinormalGeometry:
+        return generateBinormalGeometry(subset);
+    }
+    return GeometryData();
+}
+
+GeometryGenerator::GeometryData GeometryGenerator::generateOriginalGeometry(const SubsetData &subset)
+{
+    if (subset.compact)
+        return generateCompactGeometry(subset);
+
+    TraceSpan span("generate original geometry");
+    GeometryData data;
+
+    const auto &positions = subset.positions;
+    const auto &normals = subset.normals;
+    const auto &uvs = subset.uvs;
+    const auto &tangents = subset.tangents;
+    const auto &binormals = subset.binormals;
+    const auto &colors = subset.colors;
+    const int count = subset.count;
 
     // Calculate stride
     quint32 stride = 0;
     if (positions.count() == count) {
-        m_originalGeometry->addAttribute(QQuick3DGeometry::Attribute::PositionSemantic,
-                                         stride,
-                                         QQuick3DGeometry::Attribute::F32Type);
+        data.attributes.append({ QQuick3DGeometry::Attribute::PositionSemantic,
+                                 stride,
+                                 QQuick3DGeometry::Attribute::F32Type });
         stride += sizeof(QVector3D);
     }
     if (normals.count() == count) {
-        m_originalGeometry->addAttribute(QQuick3DGeometry::Attribute::NormalSemantic,
-                                         stride,
-                                         QQuick3DGeometry::Attribute::F32Type);
+        data.attributes.append({ QQuick3DGeometry::Attribute::NormalSemantic,
+                                 stride,
+                                 QQuick3DGeometry::Attribute::F32Type });
         stride += sizeof(QVector3D);
     }
     const auto &keys = uvs.keys();
@@ -194,38 +1039,43 @@ void GeometryGenerator::generateOriginalGeometry()
                 continue;
             const auto &uv = uvs[key];
             if (uv.count() == count) {
-                m_originalGeometry->addAttribute(QQuick3DGeometry::Attribute::TexCoordSemantic,
-                                                 stride,
-                                                 QQuick3DGeometry::Attribute::F32Type);
+                data.attributes.append({ QQuick3DGeometry::Attribute::TexCoordSemantic,
+                                         stride,
+                                         QQuick3DGeometry::Attribute::F32Type });
                 stride += sizeof(QVector2D);
             }
         }
     }
     if (tangents.count() == count) {
-        m_originalGeometry->addAttribute(QQuick3DGeometry::Attribute::TangentSemantic,
-                                         stride,
-                                         QQuick3DGeometry::Attribute::F32Type);
+        data.attributes.append({ QQuick3DGeometry::Attribute::TangentSemantic,
+                                 stride,
+                                 QQuick3DGeometry::Attribute::F32Type });
         stride += sizeof(QVector3D);
     }
     if (binormals.count() == count) {
-        m_originalGeometry->addAttribute(QQuick3DGeometry::Attribute::BinormalSemantic,
-                                         stride,
-                                         QQuick3DGeometry::Attribute::F32Type);
+        data.attributes.append({ QQuick3DGeometry::Attribute::BinormalSemantic,
+                                 stride,
+                                 QQuick3DGeometry::Attribute::F32Type });
         stride += sizeof(QVector3D);
     }
     if (colors.count() == count) {
-        m_originalGeometry->addAttribute(QQuick3DGeometry::Attribute::ColorSemantic,
-                                         stride,
-                                         QQuick3DGeometry::Attribute::F32Type);
+        data.attributes.append({ QQuick3DGeometry::Attribute::ColorSemantic,
+                                 stride,
+                                 QQuick3DGeometry::Attribute::F32Type });
         stride += sizeof(QVector4D);
     }
 
-    m_originalGeometry->setStride(stride);
-    m_originalGeometry->setPrimitiveType(QQuick3DGeometry::PrimitiveType::Triangles);
-    m_originalGeometry->setBounds(m_subset->bounds().min, m_subset->bounds().max);
+    data.stride = stride;
+    data.primitiveType = QQuick3DGeometry::PrimitiveType::Triangles;
+    data.boundsMin = subset.boundsMin;
+    data.boundsMax = subset.boundsMax;
 
-    QByteArray vertexBuffer;
-    vertexBuffer.resize(stride * count);
+    // The unwelded vertexes only live until they are welded, the buffer is
+    // kept per worker thread so cycling through subsets does not allocate it
+    // every time. Huge buffers are not kept around.
+    thread_local QByteArray scratchBuffer;
+    QByteArray &vertexBuffer = scratchBuffer;
+    vertexBuffer.resize(qsizetype(stride) * count);
 
     float *p = reinterpret_cast<float *>(vertexBuffer.data());
 
@@ -276,308 +1126,281 @@ void GeometryGenerator::generateOriginalGeometry()
             *p++ = color.w();
         }
     }
-    m_originalGeometry->setVertexData(vertexBuffer);
-    emit originalChanged(m_originalGeometry);
+    span.next("weld vertexes");
+    const WeldedVertexes welded = weldVertexes(vertexBuffer.constData(), stride, count);
+    data.vertexData.resize(welded.unique.count() * qsizetype(stride));
+    char *wp = data.vertexData.data();
+    for (quint32 index : welded.unique) {
+        memcpy(wp, vertexBuffer.constData() + qsizetype(index) * stride, stride);
+        wp += stride;
+    }
+    auto indexType = QQuick3DGeometry::Attribute::U32Type;
+    data.indexData = packIndexes(welded.indexes, welded.unique.count(), &indexType);
+    data.attributes.append({ QQuick3DGeometry::Attribute::IndexSemantic,
+                             0,
+                             indexType });
+    if (vertexBuffer.capacity() > maxScratchBufferSize)
+        vertexBuffer = QByteArray();
+    return data;
 }
 
-void GeometryGenerator::generateWireframeGeometry()
+GeometryGenerator::GeometryData GeometryGenerator::generateCompactGeometry(const SubsetData &subset)
 {
-    m_wireframeGeometry = new QQuick3DGeometry(this);
-
-    const auto &positions = m_subset->positions();
-    const auto &normals = m_subset->normals();
-    const int count = m_subset->count();
+    TraceSpan span("generate compact geometry");
+    GeometryData data;
+
+    const int count = subset.count;
+    const bool hasPositions = subset.positions.count() == count;
+    const bool hasNormals = subset.normals.count() == count;
+    const QVector<QVector2D> uvs = subset.uvs.value(0);
+    const bool hasUvs = uvs.count() == count;
+    const bool hasColors = subset.colors.count() == count;
+
+    QVector3D boundsMin;
+    QVector3D boundsMax;
+    if (hasPositions)
+        positionBounds(subset.positions, &boundsMin, &boundsMax);
+    const QVector3D extent = boundsMax - boundsMin;
+
+    // QQuick3DGeometry has no 16 or 8 bit float and normalized types, and
+    // custom materials only read float attributes. The packed words are
+    // integers below 2^24, which a float holds exactly, so they are handed
+    // over as float values and the CompactPreviewMaterial converts them
+    // back with uint(), no bit pattern is reinterpreted.
+    data.attributes.append({ QQuick3DGeometry::Attribute::PositionSemantic,
+                             quint32(offsetof(CompactVertex, positionColor)),
+                             QQuick3DGeometry::Attribute::F32Type });
+    data.attributes.append({ QQuick3DGeometry::Attribute::NormalSemantic,
+                             quint32(offsetof(CompactVertex, uvNormal)),
+                             QQuick3DGeometry::Attribute::F32Type });
+    data.stride = sizeof(CompactVertex);
+    data.primitiveType = QQuick3DGeometry::PrimitiveType::Triangles;
+    data.boundsMin = boundsMin;
+    data.boundsMax = boundsMax;
+
+    thread_local QByteArray scratchBuffer;
+    QByteArray &vertexBuffer = scratchBuffer;
+    vertexBuffer.resize(qsizetype(sizeof(CompactVertex)) * count);
+    auto vertex = reinterpret_cast<CompactVertex *>(vertexBuffer.data());
+    for (int i = 0; i < count; ++i, ++vertex) {
+        // Missing attributes decode to zero, missing normals like the
+        // zero length ones
+        quint16 position[3] = {};
+        quint8 color[4] = {};
+        quint16 uv[2] = {};
+        if (hasPositions) {
+            const QVector3D &source = subset.positions.at(i);
+            for (int c = 0; c < 3; ++c)
+                position[c] = toUnorm16(source[c], boundsMin[c], extent[c]);
+        }
+        if (hasColors) {
+            const QVector4D &source = subset.colors.at(i);
+            for (int c = 0; c < 4; ++c)
+                color[c] = toUnorm8(source[c]);
+        }
+        if (hasUvs) {
+            uv[0] = toHalf(uvs.at(i).x());
+            uv[1] = toHalf(uvs.at(i).y());
+        }
+        for (int c = 0; c < 3; ++c)
+            vertex->positionColor[c] = packPair(position[c], color[c]);
+        vertex->uvNormal[0] = packPair(uv[0], color[3]);
+        vertex->uvNormal[1] = float(uv[1]);
+        vertex->uvNormal[2] = GlyphTexture::packDirection(hasNormals ? subset.normals.at(i) : QVector3D());
+    }
 
-    const quint32 stride = 6 * sizeof(float);
-    const bool hasNormals = normals.count() == count;
+    // Quantizing merges more vertexes than welding the full precision ones
+    span.next("weld vertexes");
+    const quint32 stride = data.stride;
+    const WeldedVertexes welded = weldVertexes(vertexBuffer.constData(), stride, count);
+    data.vertexData.resize(welded.unique.count() * qsizetype(stride));
+    char *wp = data.vertexData.data();
+    for (quint32 index : welded.unique) {
+        memcpy(wp, vertexBuffer.constData() + qsizetype(index) * stride, stride);
+        wp += stride;
+    }
+    auto indexType = QQuick3DGeometry::Attribute::U32Type;
+    data.indexData = packIndexes(welded.indexes, welded.unique.count(), &indexType);
+    data.attributes.append({ QQuick3DGeometry::Attribute::IndexSemantic,
+                             0,
+                             indexType });
+    if (vertexBuffer.capacity() > maxScratchBufferSize)
+        vertexBuffer = QByteArray();
+    return data;
+}
 
-    m_wireframeGeometry->setStride(stride);
-    m_wireframeGeometry->setPrimitiveType(QQuick3DGeometry::PrimitiveType::Lines);
-    m_wireframeGeometry->setBounds(m_subset->bounds().min, m_subset->bounds().max);
-
-    m_wireframeGeometry->addAttribute(QQuick3DGeometry::Attribute::PositionSemantic,
-                                      0,
-                                      QQuick3DGeometry::Attribute::F32Type);
-    m_wireframeGeometry->addAttribute(QQuick3DGeometry::Attribute::NormalSemantic,
-                                      3 * sizeof(float),
-                                      QQuick3DGeometry::Attribute::F32Type);
-    m_wireframeGeometry->addAttribute(QQuick3DGeometry::Attribute::IndexSemantic,
-                                      0,
-                                      QQuick3DGeometry::Attribute::U32Type);
-
-    QByteArray vertexBuffer;
-    vertexBuffer.resize(count * stride);
-    float *vp = reinterpret_cast<float *>(vertexBuffer.data());
-
-    QByteArray indexBuffer;
-    indexBuffer.resize(count * 2 * sizeof(quint32));
-    quint32 *ip = reinterpret_cast<quint32 *>(indexBuffer.data());
-
-    for (int i = 0; i < count; i += 3) {
-        const QVector3D &pos1 = positions.at(i);
-        const QVector3D &pos2 = positions.at(i+1);
-        const QVector3D &pos3 = positions.at(i+2);
-        QVector3D normal;
-        if (hasNormals) {
-            normal = normals.at(i) + normals.at(i+1) + normals.at(i+2);
-            normal.normalize();
-        } else {
-            const QVector3D v = pos2 - pos1;
-            const QVector3D w = pos3 - pos1;
-            normal = QVector3D::crossProduct(v, w).normalized();
+QVariantMap GeometryGenerator::measureCompactPrecision(const SubsetData &subset)
+{
+    TraceSpan span("measure compact precision");
+    const int count = subset.count;
+    const QVector<QVector2D> uvs = subset.uvs.value(0);
+
+    QVector3D boundsMin;
+    QVector3D boundsMax;
+    positionBounds(subset.positions, &boundsMin, &boundsMax);
+    const QVector3D extent = boundsMax - boundsMin;
+
+    // Largest error of every attribute the subset has, positions and UVs
+    // in their own units, directions in degrees and colors per channel
+    QVariantMap report;
+    if (subset.positions.count() == count) {
+        float error = 0.0f;
+        for (const QVector3D &position : subset.positions) {
+            const QVector3D decoded(
+                        fromUnorm16(toUnorm16(position.x(), boundsMin.x(), extent.x()), boundsMin.x(), extent.x()),
+                        fromUnorm16(toUnorm16(position.y(), boundsMin.y(), extent.y()), boundsMin.y(), extent.y()),
+                        fromUnorm16(toUnorm16(position.z(), boundsMin.z(), extent.z()), boundsMin.z(), extent.z()));
+            error = qMax(error, (decoded - position).length());
         }
-        // Vertex Buffer
-        // 0
-        *vp++ = pos1.x();
-        *vp++ = pos1.y();
-        *vp++ = pos1.z();
-        *vp++ = normal.x();
-        *vp++ = normal.y();
-        *vp++ = normal.z();
-
-        // 1
-        *vp++ = pos2.x();
-        *vp++ = pos2.y();
-        *vp++ = pos2.z();
-        *vp++ = normal.x();
-        *vp++ = normal.y();
-        *vp++ = normal.z();
-
-        // 2
-        *vp++ = pos3.x();
-        *vp++ = pos3.y();
-        *vp++ = pos3.z();
-        *vp++ = normal.x();
-        *vp++ = normal.y();
-        *vp++ = normal.z();
-
-        // Index Buffer
-        *ip++ = i;
-        *ip++ = i+1;
-
-        *ip++ = i+1;
-        *ip++ = i+2;
-
-        *ip++ = i+2;
-        *ip++ = i;
-    }
-    m_wireframeGeometry->setVertexData(vertexBuffer);
-    m_wireframeGeometry->setIndexData(indexBuffer);
-    emit wireframeChanged(m_wireframeGeometry);
-}
-
-void GeometryGenerator::generateNormalGeometry()
-{
-    m_normalsLinesGeometry = new QQuick3DGeometry(this);
-    const auto &positions = m_subset->positions();
-    const auto &normals = m_subset->normals();
-    const int count = m_subset->count();
-
-    const quint32 stride = 3 * sizeof(float);
-    const bool hasNormals = normals.count() == count;
+        report.insert(QStringLiteral("position"), error);
+    }
+    if (subset.normals.count() == count) {
+        float error = 0.0f;
+        for (const QVector3D &normal : subset.normals) {
+            const QVector3D decoded = GlyphTexture::unpackDirection(GlyphTexture::packDirection(normal));
+            error = qMax(error, directionError(normal, decoded));
+        }
+        report.insert(QStringLiteral("normal"), error);
+    }
+    if (uvs.count() == count) {
+        float error = 0.0f;
+        for (const QVector2D &uv : uvs) {
+            error = qMax(error, qAbs(fromHalf(toHalf(uv.x())) - uv.x()));
+            error = qMax(error, qAbs(fromHalf(toHalf(uv.y())) - uv.y()));
+        }
+        report.insert(QStringLiteral("uv"), error);
+    }
+    if (subset.colors.count() == count) {
+        float error = 0.0f;
+        for (const QVector4D &color : subset.colors) {
+            for (int i = 0; i < 4; ++i)
+                error = qMax(error, qAbs(toUnorm8(color[i]) / 255.0f - color[i]));
+        }
+        report.insert(QStringLiteral("color"), error);
+    }
+    return report;
+}
+
+GeometryGenerator::GeometryData GeometryGenerator::generateWireframeGeometry(const SubsetData &subset)
+{
+    TraceSpan span("generate wireframe geometry");
+    GeometryData data;
+
+    const auto &positions = subset.positions;
+    const int count = subset.count;
+    if (positions.count() != count)
+        return data;
+
+    // Lines between the welded positions, each edge shared by triangles
+    // drawn once. The material is unlit, so no normals are needed.
+    const quint32 stride = sizeof(QVector3D);
+    data.stride = stride;
+    data.primitiveType = QQuick3DGeometry::PrimitiveType::Lines;
+    data.boundsMin = subset.boundsMin;
+    data.boundsMax = subset.boundsMax;
+
+    const char *soup = reinterpret_cast<const char *>(positions.constData());
+    const WeldedVertexes welded = weldVertexes(soup, stride, count);
+    span.next("find unique edges");
+    const QVector<quint32> edges = uniqueEdges(welded.indexes);
+
+    data.vertexData.resize(welded.unique.count() * qsizetype(stride));
+    float *vp = reinterpret_cast<float *>(data.vertexData.data());
+    for (quint32 index : welded.unique) {
+        const QVector3D &pos = positions.at(index);
+        *vp++ = pos.x();
+        *vp++ = pos.y();
+        *vp++ = pos.z();
+    }
+    auto indexType = QQuick3DGeometry::Attribute::U32Type;
+    data.indexData = packIndexes(edges, welded.unique.count(), &indexType);
+
+    data.attributes.append({ QQuick3DGeometry::Attribute::PositionSemantic,
+                             0,
+                             QQuick3DGeometry::Attribute::F32Type });
+    data.attributes.append({ QQuick3DGeometry::Attribute::IndexSemantic,
+                             0,
+                             indexType });
+    return data;
+}
 
-    m_normalsLinesGeometry->setStride(stride);
-    m_normalsLinesGeometry->setPrimitiveType(QQuick3DGeometry::PrimitiveType::Lines);
-    // TODO: Not quite true
-    m_normalsLinesGeometry->setBounds(m_subset->bounds().min, m_subset->bounds().max);
-
-    m_normalsLinesGeometry->addAttribute(QQuick3DGeometry::Attribute::PositionSemantic,
-                                         0,
-                                         QQuick3DGeometry::Attribute::F32Type);
-    m_normalsLinesGeometry->addAttribute(QQuick3DGeometry::Attribute::IndexSemantic,
-                                         0,
-                                         QQuick3DGeometry::Attribute::U32Type);
-
-    // If there are no normals, just do face normals
-    int normalCount = (count / 3);
-    // If there are normals, handle each vertex normals as well
-    if (hasNormals)
-        normalCount += count;
-
-    QByteArray vertexBuffer;
-    vertexBuffer.resize(normalCount * 2 * stride);
-    QVector3D *vp = reinterpret_cast<QVector3D *>(vertexBuffer.data());
-
-    QByteArray indexBuffer;
-    indexBuffer.resize(normalCount * 2 * sizeof(quint32));
-    quint32 *ip = reinterpret_cast<quint32 *>(indexBuffer.data());
-
-    quint32 index = 0;
-    for (int i = 0; i < count; i += 3) {
+GeometryGenerator::GeometryData GeometryGenerator::generateNormalGeometry(const SubsetData &subset)
+{
+    TraceSpan span("generate normal geometry");
+    const auto &positions = subset.positions;
+    const auto &normals = subset.normals;
+    const int count = subset.count;
+    const bool hasNormals = normals.count() == count;
+    if (positions.count() != count)
+        return GeometryData();
+
+    // A face normal for every triangle, and the normals of its vertexes
+    // when there are normals. Vertexes past the last triangle get none.
+    const int glyphCount = count / 3 * (hasNormals ? 4 : 1);
+    QByteArray records;
+    // Padded to whole texture rows
+    records.resize(GlyphTexture::paddedSize(glyphCount));
+    GlyphTexture::fillPadding(&records, glyphCount);
+    auto rp = reinterpret_cast<GlyphTexture::Record *>(records.data());
+
+    for (int i = 0; i + 2 < count; i += 3) {
         const QVector3D &pos1 = positions.at(i);
         const QVector3D &pos2 = positions.at(i+1);
         const QVector3D &pos3 = positions.at(i+2);
         const QVector3D v = pos2 - pos1;
         const QVector3D w = pos3 - pos1;
-        const QVector3D faceNormal = QVector3D::crossProduct(v, w).normalized();
+        const QVector3D faceNormal = QVector3D::crossProduct(v, w);
         const QVector3D faceCenter = (pos1 + pos2 + pos3) / 3;
-        *vp++ = faceCenter;
-        *vp++ = faceCenter + faceNormal * m_scaleFactor;
-        *ip++ = index;
-        *ip++ = index + 1;
-        index += 2;
+        *rp++ = GlyphTexture::makeRecord(faceCenter, faceNormal);
 
         if (hasNormals) {
-            const QVector3D normal1 = normals.at(i);
-            const QVector3D normal2 = normals.at(i+1);
-            const QVector3D normal3 = normals.at(i+2);
-
-            *vp++ = pos1;
-            *vp++ = pos1 + normal1 * m_scaleFactor;
-            *ip++ = index;
-            *ip++ = index + 1;
-
-            *vp++ = pos2;
-            *vp++ = pos2 + normal2 * m_scaleFactor;
-            *ip++ = index + 2;
-            *ip++ = index + 3;
-
-            *vp++ = pos3;
-            *vp++ = pos3 + normal3 * m_scaleFactor;
-            *ip++ = index + 4;
-            *ip++ = index + 5;
-            index += 6;
+            *rp++ = GlyphTexture::makeRecord(pos1, normals.at(i));
+            *rp++ = GlyphTexture::makeRecord(pos2, normals.at(i+1));
+            *rp++ = GlyphTexture::makeRecord(pos3, normals.at(i+2));
         }
     }
 
-    m_normalsLinesGeometry->setVertexData(vertexBuffer);
-    m_normalsLinesGeometry->setIndexData(indexBuffer);
-
-    emit normalsChanged(m_normalsLinesGeometry);
+    return glyphData(subset, records);
 }
 
-void GeometryGenerator::generateTangentGeometry()
+GeometryGenerator::GeometryData GeometryGenerator::generateTangentGeometry(const SubsetData &subset)
 {
-    const auto &positions = m_subset->positions();
-    const auto &tangents = m_subset->tangents();
-    const int count = m_subset->count();
-
-    const quint32 stride = 3 * sizeof(float);
-    const bool hasTangents = tangents.count() == count;
-
-    if (!hasTangents)
-        return;
-
-    m_tangetsLinesGeometry = new QQuick3DGeometry(this);
-
-    m_tangetsLinesGeometry->setStride(stride);
-    m_tangetsLinesGeometry->setPrimitiveType(QQuick3DGeometry::PrimitiveType::Lines);
-    // TODO: Not quite true
-    m_tangetsLinesGeometry->setBounds(m_subset->bounds().min, m_subset->bounds().max);
-
-    m_tangetsLinesGeometry->addAttribute(QQuick3DGeometry::Attribute::PositionSemantic,
-                                         0,
-                                         QQuick3DGeometry::Attribute::F32Type);
-    m_tangetsLinesGeometry->addAttribute(QQuick3DGeometry::Attribute::IndexSemantic,
-                                         0,
-                                         QQuick3DGeometry::Attribute::U32Type);
-
-    QByteArray vertexBuffer;
-    vertexBuffer.resize(count * 2 * stride);
-    QVector3D *vp = reinterpret_cast<QVector3D *>(vertexBuffer.data());
-
-    QByteArray indexBuffer;
-    indexBuffer.resize(count * 2 * sizeof(quint32));
-    quint32 *ip = reinterpret_cast<quint32 *>(indexBuffer.data());
-
-    quint32 index = 0;
-    for (int i = 0; i < count; i += 3) {
-        const QVector3D &pos1 = positions.at(i);
-        const QVector3D &pos2 = positions.at(i+1);
-        const QVector3D &pos3 = positions.at(i+2);
-
-        const QVector3D tangent1 = tangents.at(i);
-        const QVector3D tangent2 = tangents.at(i+1);
-        const QVector3D tangent3 = tangents.at(i+2);
-
-        *vp++ = pos1;
-        *vp++ = pos1 + tangent1 * m_scaleFactor;
-        *ip++ = index;
-        *ip++ = index + 1;
-
-        *vp++ = pos2;
-        *vp++ = pos2 + tangent2 * m_scaleFactor;
-        *ip++ = index + 2;
-        *ip++ = index + 3;
-
-        *vp++ = pos3;
-        *vp++ = pos3 + tangent3 * m_scaleFactor;
-        *ip++ = index + 4;
-        *ip++ = index + 5;
-        index += 6;
-    }
-
-    m_tangetsLinesGeometry->setVertexData(vertexBuffer);
-    m_tangetsLinesGeometry->setIndexData(indexBuffer);
-
-    emit tangentsChanged(m_tangetsLinesGeometry);
+    TraceSpan span("generate tangent geometry");
+    return vectorGlyphData(subset, subset.tangents);
 }
 
-void GeometryGenerator::generateBinormalGeometry()
+GeometryGenerator::GeometryData GeometryGenerator::generateBinormalGeometry(const SubsetData &subset)
 {
-    const auto &positions = m_subset->positions();
-    const auto &binormals = m_subset->binormals();
-    const int count = m_subset->count();
-
-    const quint32 stride = 3 * sizeof(float);
-    const bool hasBinormals = binormals.count() == count;
-
-    if (!hasBinormals)
-        return;
-
-    m_binormalsLinesGeometry = new QQuick3DGeometry(this);
-
-    m_binormalsLinesGeometry->setStride(stride);
-    m_binormalsLinesGeometry->setPrimitiveType(QQuick3DGeometry::PrimitiveType::Lines);
-    // TODO: Not quite true
-    m_binormalsLinesGeometry->setBounds(m_subset->bounds().min, m_subset->bounds().max);
-
-    m_binormalsLinesGeometry->addAttribute(QQuick3DGeometry::Attribute::PositionSemantic,
-                                           0,
-                                           QQuick3DGeometry::Attribute::F32Type);
-    m_binormalsLinesGeometry->addAttribute(QQuick3DGeometry::Attribute::IndexSemantic,
-                                           0,
-                                           QQuick3DGeometry::Attribute::U32Type);
-
-    QByteArray vertexBuffer;
-    vertexBuffer.resize(count * 2 * stride);
-    QVector3D *vp = reinterpret_cast<QVector3D *>(vertexBuffer.data());
-
-    QByteArray indexBuffer;
-    indexBuffer.resize(count * 2 * sizeof(quint32));
-    quint32 *ip = reinterpret_cast<quint32 *>(indexBuffer.data());
-
-    quint32 index = 0;
-    for (int i = 0; i < count; i += 3) {
-        const QVector3D &pos1 = positions.at(i);
-        const QVector3D &pos2 = positions.at(i+1);
-        const QVector3D &pos3 = positions.at(i+2);
-
-        const QVector3D binormal1 = binormals.at(i);
-        const QVector3D binormal2 = binormals.at(i+1);
-        const QVector3D binormal3 = binormals.at(i+2);
-
-        *vp++ = pos1;
-        *vp++ = pos1 + binormal1 * m_scaleFactor;
-        *ip++ = index;
-        *ip++ = index + 1;
-
-        *vp++ = pos2;
-        *vp++ = pos2 + binormal2 * m_scaleFactor;
-        *ip++ = index + 2;
-        *ip++ = index + 3;
-
-        *vp++ = pos3;
-        *vp++ = pos3 + binormal3 * m_scaleFactor;
-        *ip++ = index + 4;
-        *ip++ = index + 5;
-        index += 6;
-    }
+    TraceSpan span("generate binormal geometry");
+    return vectorGlyphData(subset, subset.binormals);
+}
 
-    m_binormalsLinesGeometry->setVertexData(vertexBuffer);
-    m_binormalsLinesGeometry->setIndexData(indexBuffer);
+GeometryGenerator::GeometryData GeometryGenerator::vectorGlyphData(const SubsetData &subset,
+                                                                   const QVector<QVector3D> &vectors)
+{
+    const auto &positions = subset.positions;
+    const int count = subset.count;
+    if (positions.count() != count || vectors.count() != count)
+        return GeometryData();
+
+    QByteArray records;
+    records.resize(GlyphTexture::paddedSize(count));
+    GlyphTexture::fillPadding(&records, count);
+    auto rp = reinterpret_cast<GlyphTexture::Record *>(records.data());
+    for (int i = 0; i < count; ++i)
+        *rp++ = GlyphTexture::makeRecord(positions.at(i), vectors.at(i));
+    return glyphData(subset, records);
+}
 
-    emit binormalsChanged(m_binormalsLinesGeometry);
+GeometryGenerator::GeometryData GeometryGenerator::glyphData(const SubsetData &subset, const QByteArray &records)
+{
+    GeometryData data;
+    data.stride = sizeof(GlyphTexture::Record);
+    data.primitiveType = QQuick3DGeometry::PrimitiveType::Lines;
+    data.boundsMin = subset.boundsMin;
+    data.boundsMax = subset.boundsMax;
+    data.vertexData = records;
+    return data;
 }
 
 QSSGRenderGraphObject *GeometryGenerator::updateSpatialNode(QSSGRenderGraphObject *node)
@@ -29,7 +29,10 @@
 
 #include <QtQuick3D/QQuick3DObject>
 #include <QtQuick3D/QQuick3DGeometry>
+#include <QCache>
 
+#include "diskcache.h"
+#include "glyphtexture.h"
 #include "mesh.h"
 #include "meshinfo.h"
 
@@ -39,29 +42,160 @@ class GeometryGenerator : public QQuick3DObject
     Q_OBJECT
     Q_PROPERTY(QQuick3DGeometry* original READ original NOTIFY originalChanged)
     Q_PROPERTY(QQuick3DGeometry* wireframe READ wireframe NOTIFY wireframeChanged)
-    Q_PROPERTY(QQuick3DGeometry* normals READ normals NOTIFY normalsChanged)
-    Q_PROPERTY(QQuick3DGeometry* tangents READ tangents NOTIFY tangentsChanged)
-    Q_PROPERTY(QQuick3DGeometry* binormals READ binormals NOTIFY binormalsChanged)
+    Q_PROPERTY(QQuick3DGeometry* glyph READ glyph CONSTANT)
+    Q_PROPERTY(int glyphChunkSize READ glyphChunkSize CONSTANT)
+    Q_PROPERTY(GlyphTexture* normals READ normals NOTIFY normalsChanged)
+    Q_PROPERTY(GlyphTexture* tangents READ tangents NOTIFY tangentsChanged)
+    Q_PROPERTY(GlyphTexture* binormals READ binormals NOTIFY binormalsChanged)
+    Q_PROPERTY(float glyphScale READ glyphScale WRITE setGlyphScale NOTIFY glyphScaleChanged)
+    Q_PROPERTY(float glyphLength READ glyphLength NOTIFY glyphLengthChanged)
+    Q_PROPERTY(bool compactPreview READ compactPreview WRITE setCompactPreview NOTIFY compactPreviewChanged)
+    Q_PROPERTY(bool originalCompact READ originalCompact NOTIFY geometriesPublished)
+    Q_PROPERTY(QVector3D originalBoundsMin READ originalBoundsMin NOTIFY geometriesPublished)
+    Q_PROPERTY(QVector3D originalBoundsMax READ originalBoundsMax NOTIFY geometriesPublished)
+    Q_PROPERTY(QVariantMap precisionReport READ precisionReport NOTIFY geometriesPublished)
+    Q_PROPERTY(bool wireframeEnabled READ wireframeEnabled WRITE setWireframeEnabled NOTIFY wireframeEnabledChanged)
+    Q_PROPERTY(bool normalsEnabled READ normalsEnabled WRITE setNormalsEnabled NOTIFY normalsEnabledChanged)
+    Q_PROPERTY(bool tangentsEnabled READ tangentsEnabled WRITE setTangentsEnabled NOTIFY tangentsEnabledChanged)
+    Q_PROPERTY(bool binormalsEnabled READ binormalsEnabled WRITE setBinormalsEnabled NOTIFY binormalsEnabledChanged)
+    Q_PROPERTY(bool hasTangents READ hasTangents NOTIFY geometriesPublished)
+    Q_PROPERTY(bool hasBinormals READ hasBinormals NOTIFY geometriesPublished)
     Q_PROPERTY(MeshInfo* meshInfo READ meshInfo WRITE setMeshInfo NOTIFY meshInfoChanged)
     Q_PROPERTY(int subsetIndex READ subsetIndex WRITE setSubsetIndex NOTIFY subsetIndexChanged)
     Q_PROPERTY(float scaleFactor READ scaleFactor NOTIFY scaleFactorChanged)
+    Q_PROPERTY(qint64 cacheHits READ cacheHits NOTIFY cacheStatisticsChanged)
+    Q_PROPERTY(qint64 cacheMisses READ cacheMisses NOTIFY cacheStatisticsChanged)
+    Q_PROPERTY(qint64 cacheSize READ cacheSize NOTIFY cacheStatisticsChanged)
+    Q_PROPERTY(qint64 diskCacheHits READ diskCacheHits NOTIFY cacheStatisticsChanged)
+    Q_PROPERTY(qint64 maxCacheSize READ maxCacheSize WRITE setMaxCacheSize NOTIFY maxCacheSizeChanged)
+    Q_PROPERTY(int sourceVertexCount READ sourceVertexCount NOTIFY geometriesPublished)
+    Q_PROPERTY(int weldedVertexCount READ weldedVertexCount NOTIFY geometriesPublished)
     QML_ELEMENT
 public:
+    enum GeometryKind {
+        OriginalGeometry,
+        WireframeGeometry,
+        NormalGeometry,
+        TangentGeometry,
+        BinormalGeometry
+    };
+
+    // Everything needed to set up a QQuick3DGeometry, without the QObject
+    struct GeometryData {
+        struct Attribute {
+            QQuick3DGeometry::Attribute::Semantic semantic;
+            quint32 offset;
+            QQuick3DGeometry::Attribute::ComponentType componentType;
+        };
+        QQuick3DGeometry::PrimitiveType primitiveType = QQuick3DGeometry::PrimitiveType::Triangles;
+        quint32 stride = 0;
+        QVector<Attribute> attributes;
+        QVector3D boundsMin;
+        QVector3D boundsMax;
+        QByteArray vertexData;
+        QByteArray indexData;
+
+        qint64 bytes() const { return vertexData.size() + indexData.size(); }
+    };
+
+    // The decoded attributes the geometry is generated from. Decoded by the
+    // generate job from its copy of the subset, see Mesh::Subset::sharedCopy(),
+    // the workers never touch the subset, which can be deleted while they run.
+    struct SubsetData {
+        QVector<QVector3D> positions;
+        QVector<QVector3D> normals;
+        QMap<int, QVector<QVector2D>> uvs;
+        QVector<QVector3D> tangents;
+        QVector<QVector3D> binormals;
+        QVector<QVector4D> colors;
+        int count = 0;
+        QVector3D boundsMin;
+        QVector3D boundsMax;
+        bool compact = false;
+    };
+
+    // Decodes the attributes of the subset that are not decoded yet
+    static SubsetData subsetData(const Mesh::Subset *subset, bool compact);
+    // Generates one geometry, without the cache, on the calling thread
+    static GeometryData generateGeometry(GeometryKind kind, const SubsetData &subset);
+
     GeometryGenerator(QQuick3DObject *parent = nullptr);
     void setSubset(Mesh::Subset *subset);
 
     QQuick3DGeometry* original() const;
     QQuick3DGeometry* wireframe() const;
-    QQuick3DGeometry* normals() const;
-    QQuick3DGeometry* tangents() const;
-    QQuick3DGeometry* binormals() const;
+    // Normals, tangents and binormals are drawn by GlyphMaterial from the
+    // records in their texture. The glyph geometry holds the lines of one
+    // chunk of glyphChunkSize glyphs, an overlay is drawn a chunk at a time.
+    QQuick3DGeometry* glyph() const;
+    int glyphChunkSize() const;
+    GlyphTexture* normals() const;
+    GlyphTexture* tangents() const;
+    GlyphTexture* binormals() const;
+    // Glyph length relative to the default of 1/100 of the subset extents,
+    // changing it does not generate the glyphs again
+    float glyphScale() const;
+    float glyphLength() const;
+
+    // Generates the original geometry in a compact layout that needs the
+    // CompactPreviewMaterial to decode it. Each vertex is 24 bytes in the
+    // POSITION and NORMAL slots, six floats that each hold an integer below
+    // 2^24 exactly:
+    //  - position as unorm16 relative to the bounds, and UV0 as half floats
+    //  - color as unorm8 in the bits above them
+    //  - normal octahedral encoded like GlyphTexture::packDirection
+    bool compactPreview() const;
+    // Layout of the published original geometry, which lags behind
+    // compactPreview while the geometry is generated
+    bool originalCompact() const;
+    QVector3D originalBoundsMin() const;
+    QVector3D originalBoundsMax() const;
+    // Largest error of every attribute after a round trip through the
+    // compact layout, empty while compactPreview is off
+    QVariantMap precisionReport() const;
+
+    // Overlays are only generated while they are enabled, the original
+    // geometry is always generated
+    bool wireframeEnabled() const;
+    bool normalsEnabled() const;
+    bool tangentsEnabled() const;
+    bool binormalsEnabled() const;
+    // Whether the subset has the attributes the overlays are generated from
+    bool hasTangents() const;
+    bool hasBinormals() const;
+
     MeshInfo* meshInfo() const;
     int subsetIndex() const;
     float scaleFactor() const;
 
+    // Bytes of the vertex and index data of all generated geometry
+    qint64 geometryBytes() const;
+
+    // Generated buffers are kept in a least recently used cache, so going
+    // back to a subset does not generate its geometry again
+    qint64 cacheHits() const;
+    qint64 cacheMisses() const;
+    qint64 cacheSize() const;
+    qint64 maxCacheSize() const;
+    // Subsets whose geometry came from the disk cache instead of being generated
+    qint64 diskCacheHits() const;
+
+    // The original geometry is indexed, identical vertexes of the subset are
+    // welded into one. These are the vertexes before and after welding.
+    int sourceVertexCount() const;
+    int weldedVertexCount() const;
+
 public slots:
+    void setWireframeEnabled(bool wireframeEnabled);
+    void setGlyphScale(float glyphScale);
+    void setCompactPreview(bool compactPreview);
+    void setNormalsEnabled(bool normalsEnabled);
+    void setTangentsEnabled(bool tangentsEnabled);
+    void setBinormalsEnabled(bool binormalsEnabled);
     void setMeshInfo(MeshInfo* meshInfo);
     void setSubsetIndex(int subsetIndex);
+    void setMaxCacheSize(qint64 maxCacheSize);
+    void clearCache();
 
 private slots:
     void updateSubset();
@@ -69,31 +203,128 @@ private slots:
 signals:
     void originalChanged(QQuick3DGeometry* original);
     void wireframeChanged(QQuick3DGeometry* wireframe);
-    void normalsChanged(QQuick3DGeometry* normals);
-    void tangentsChanged(QQuick3DGeometry* tangents);
-    void binormalsChanged(QQuick3DGeometry* binormals);
+    void normalsChanged(GlyphTexture* normals);
+    void tangentsChanged(GlyphTexture* tangents);
+    void binormalsChanged(GlyphTexture* binormals);
+    void glyphScaleChanged(float glyphScale);
+    void glyphLengthChanged(float glyphLength);
+    void compactPreviewChanged(bool compactPreview);
+    void wireframeEnabledChanged(bool wireframeEnabled);
+    void normalsEnabledChanged(bool normalsEnabled);
+    void tangentsEnabledChanged(bool tangentsEnabled);
+    void binormalsEnabledChanged(bool binormalsEnabled);
     void meshInfoChanged(MeshInfo* meshInfo);
     void subsetIndexChanged(int subsetIndex);
     void scaleFactorChanged(float scaleFactor);
+    void cacheStatisticsChanged();
+    // The geometry objects were updated, also when the properties stayed the same
+    void geometriesPublished();
+    void maxCacheSizeChanged(qint64 maxCacheSize);
 
 private:
+    // Geometries that are published together, once the missing ones are generated
+    struct GenerateJob {
+        quint64 generation = 0;
+        QVector<GeometryKind> kinds;
+        // Kinds that were enabled when the job was started
+        QVector<GeometryKind> enabled;
+        QVector<GeometryKind> missing;
+        QVector<GeometryData> geometries = QVector<GeometryData>(BinormalGeometry + 1);
+        int sourceVertexCount = 0;
+        bool compact = false;
+    };
+
+    // Cached geometries, and the channels of the disk cache, are by slot.
+    // The compact original geometry has its own slot after the kinds.
+    enum { CompactOriginalSlot = BinormalGeometry + 1, SlotCount };
+    static int cacheSlot(GeometryKind kind, bool compact)
+    {
+        return kind == OriginalGeometry && compact ? int(CompactOriginalSlot) : int(kind);
+    }
+
+    // What a generate job made on its worker, applied on the GUI thread
+    struct GenerateResult {
+        // By the index of the kind in GenerateJob::missing
+        QVector<GeometryData> geometries;
+        // Every slot that was restored from the disk cache
+        QHash<int, GeometryData> restored;
+        // The copy of the subset, with the attributes it decoded
+        QSharedPointer<Mesh> decoded;
+    };
+
+    struct CacheKey {
+        quint64 subset;
+        int slot;
+
+        friend bool operator==(const CacheKey &a, const CacheKey &b) {
+            return a.subset == b.subset && a.slot == b.slot;
+        }
+        friend size_t qHash(const CacheKey &key, size_t seed = 0) {
+            return qHashMulti(seed, key.subset, key.slot);
+        }
+    };
+
     void generate();
-    void generateOriginalGeometry();
-    void generateWireframeGeometry();
-    void generateNormalGeometry();
-    void generateTangentGeometry();
-    void generateBinormalGeometry();
+    void updateOverlay(GeometryKind kind);
+    void requestGeometries(const QVector<GeometryKind> &kinds);
+    void publishGeometries(const GenerateJob &job);
+    bool isEnabled(GeometryKind kind) const;
+    QQuick3DGeometry *geometryObject(GeometryKind kind) const;
+    GlyphTexture *glyphTexture(GeometryKind kind) const;
+    void updateGlyphLength();
+    void updateGlyphBounds();
+    bool isPublished(GeometryKind kind) const;
+    void setGeometry(GeometryKind kind, const GeometryData &data);
+    static GenerateResult runGenerateJob(const GenerateJob &job, const QSharedPointer<Mesh> &mesh);
+    static QHash<int, GeometryData> restoreFromDiskCache(const DiskCache::Record &record, bool compact);
+    static void storeToDiskCache(const QString &key, const Mesh::Subset *subset,
+                                 const QHash<int, GeometryData> &geometries);
+    static GeometryData generateOriginalGeometry(const SubsetData &subset);
+    static GeometryData generateCompactGeometry(const SubsetData &subset);
+    static QVariantMap measureCompactPrecision(const SubsetData &subset);
+    static GeometryData generateWireframeGeometry(const SubsetData &subset);
+    static GeometryData generateNormalGeometry(const SubsetData &subset);
+    static GeometryData generateTangentGeometry(const SubsetData &subset);
+    static GeometryData generateBinormalGeometry(const SubsetData &subset);
+    static GeometryData vectorGlyphData(const SubsetData &subset, const QVector<QVector3D> &vectors);
+    static GeometryData glyphData(const SubsetData &subset, const QByteArray &records);
 
     QQuick3DGeometry *m_originalGeometry = nullptr;
     QQuick3DGeometry *m_wireframeGeometry = nullptr;
-    QQuick3DGeometry *m_normalsLinesGeometry = nullptr;
-    QQuick3DGeometry *m_tangetsLinesGeometry = nullptr;
-    QQuick3DGeometry *m_binormalsLinesGeometry = nullptr;
+    QQuick3DGeometry *m_glyphGeometry = nullptr;
+    GlyphTexture *m_normalsTexture = nullptr;
+    GlyphTexture *m_tangentsTexture = nullptr;
+    GlyphTexture *m_binormalsTexture = nullptr;
+    // Kinds whose geometry has data, the others are null to QML
+    quint32 m_publishedGeometries = 0;
+
+    bool m_wireframeEnabled = false;
+    bool m_normalsEnabled = false;
+    bool m_tangentsEnabled = false;
+    bool m_binormalsEnabled = false;
 
     Mesh::Subset *m_subset = nullptr;
     MeshInfo* m_meshInfo = nullptr;
     int m_subsetIndex = 0;
     float m_scaleFactor = 1.0f;
+    float m_glyphScale = 1.0f;
+    bool m_compactPreview = false;
+    bool m_originalCompact = false;
+    QVector3D m_originalBoundsMin;
+    QVector3D m_originalBoundsMax;
+    // Measured once per subset
+    mutable quint64 m_precisionSubset = 0;
+    mutable QVariantMap m_precisionReport;
+    // Results of jobs started before the subset changed are dropped
+    quint64 m_generation = 0;
+    // Generation of the subset whose geometries are still being generated
+    quint64 m_pendingGeneration = 0;
+    int m_sourceVertexCount = 0;
+
+    QCache<CacheKey, GeometryData> m_cache;
+    qint64 m_cacheHits = 0;
+    qint64 m_cacheMisses = 0;
+    qint64 m_diskCacheHits = 0;
 
 protected:
     QSSGRenderGraphObject *updateSpatialNode(QSSGRenderGraphObject *node) override;
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2023 Andy Nichols <nezticle@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "glyphtexture.h"
+
+#include <QSize>
+
+namespace {
+// Marks a direction of zero length, not a valid encoding
+const float zeroDirection = -1.0f;
+// Each component is a snorm12 style value, 0 and +-1 are exact
+const float componentScale = 2047.0f;
+
+quint32 toComponent(float value)
+{
+    return quint32(qRound(qBound(-1.0f, value, 1.0f) * componentScale) + 2047);
+}
+
+float fromComponent(quint32 value)
+{
+    return (float(value) - 2047.0f) / componentScale;
+}
+
+float signNotZero(float value)
+{
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+}
+
+GlyphTexture::GlyphTexture(QQuick3DObject *parent)
+    : QQuick3DTextureData(parent)
+{
+    setFormat(QQuick3DTextureData::RGBA32F);
+}
+
+int GlyphTexture::recordCount() const
+{
+    return int(m_records.size() / qsizetype(sizeof(Record)));
+}
+
+QByteArray GlyphTexture::records() const
+{
+    return m_records;
+}
+
+void GlyphTexture::setRecords(const QByteArray &records)
+{
+    const int oldCount = recordCount();
+    // Shared with the cache, not copied, when it is padded already
+    m_records = records;
+    const int count = recordCount();
+    if (m_records.size() != paddedSize(count)) {
+        m_records.resize(paddedSize(count));
+        fillPadding(&m_records, count);
+    }
+
+    const int rows = (recordCount() + rowLength - 1) / rowLength;
+    setSize(rows > 0 ? QSize(rowLength, rows) : QSize());
+    setTextureData(m_records);
+    if (recordCount() != oldCount)
+        emit recordCountChanged(recordCount());
+}
+
+qsizetype GlyphTexture::paddedSize(int count)
+{
+    const qsizetype rows = (qsizetype(count) + rowLength - 1) / rowLength;
+    return rows * rowLength * qsizetype(sizeof(Record));
+}
+
+void GlyphTexture::fillPadding(QByteArray *records, int count)
+{
+    const Record padding = makeRecord(QVector3D(), QVector3D());
+    auto record = reinterpret_cast<Record *>(records->data());
+    const int paddedCount = int(records->size() / qsizetype(sizeof(Record)));
+    for (int i = count; i < paddedCount; ++i)
+        record[i] = padding;
+}
+
+GlyphTexture::Record GlyphTexture::makeRecord(const QVector3D &position, const QVector3D &direction)
+{
+    Record record;
+    record.position[0] = position.x();
+    record.position[1] = position.y();
+    record.position[2] = position.z();
+    record.direction = packDirection(direction);
+    return record;
+}
+
+QVector3D GlyphTexture::decodeDirection(const Record &record)
+{
+    return unpackDirection(record.direction);
+}
+
+float GlyphTexture::packDirection(const QVector3D &direction)
+{
+    const float l1 = qAbs(direction.x()) + qAbs(direction.y()) + qAbs(direction.z());
+    if (qFuzzyIsNull(l1))
+        return zeroDirection;
+
+    // Projected onto the octahedron, the lower half folded over the upper one
+    float x = direction.x() / l1;
+    float y = direction.y() / l1;
+    if (direction.z() < 0.0f) {
+        const float foldedX = (1.0f - qAbs(y)) * signNotZero(x);
+        const float foldedY = (1.0f - qAbs(x)) * signNotZero(y);
+        x = foldedX;
+        y = foldedY;
+    }
+    // At most 24 bits, which a float holds exactly
+    return float((toComponent(x) << 12) | toComponent(y));
+}
+
+QVector3D GlyphTexture::unpackDirection(float packed)
+{
+    if (packed < 0.0f)
+        return QVector3D();
+
+    const quint32 bits = quint32(packed);
+    float x = fromComponent(bits >> 12);
+    float y = fromComponent(bits & 0xfff);
+    const float z = 1.0f - qAbs(x) - qAbs(y);
+    if (z < 0.0f) {
+        const float unfoldedX = (1.0f - qAbs(y)) * signNotZero(x);
+        const float unfoldedY = (1.0f - qAbs(x)) * signNotZero(y);
+        x = unfoldedX;
+        y = unfoldedY;
+    }
+    return QVector3D(x, y, z).normalized();
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2023 Andy Nichols <nezticle@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GLYPHTEXTURE_H
+#define GLYPHTEXTURE_H
+
+#include <QtQuick3D/QQuick3DTextureData>
+#include <QVector3D>
+
+// The glyph records of a normal, tangent or binormal overlay as an RGBA32F
+// texture, one texel per record. GlyphMaterial draws the shared glyph
+// geometry of GeometryGenerator at every texel, so a glyph costs its record
+// and nothing else. Records are padded to whole rows with zero directions,
+// which are not drawn.
+class GlyphTexture : public QQuick3DTextureData
+{
+    Q_OBJECT
+    Q_PROPERTY(int recordCount READ recordCount NOTIFY recordCountChanged)
+    QML_ELEMENT
+    QML_UNCREATABLE("Created by GeometryGenerator")
+public:
+    struct Record {
+        float position[3];
+        // Octahedral encoded unit direction, see packDirection()
+        float direction;
+    };
+    // Texels per row of the texture, GlyphMaterial relies on it
+    static const int rowLength = 4096;
+
+    explicit GlyphTexture(QQuick3DObject *parent = nullptr);
+
+    // Records including the padding
+    int recordCount() const;
+    QByteArray records() const;
+    void setRecords(const QByteArray &records);
+
+    // Bytes of count records padded to whole rows, and the padding itself
+    static qsizetype paddedSize(int count);
+    static void fillPadding(QByteArray *records, int count);
+
+    // Directions of zero length are kept, their glyphs are not drawn
+    static Record makeRecord(const QVector3D &position, const QVector3D &direction);
+    static QVector3D decodeDirection(const Record &record);
+    // Octahedral encoding of a direction as two 12 bit values, held as the
+    // integer value of the float so it survives any float conversion
+    // exactly. A zero vector encodes to -1.
+    static float packDirection(const QVector3D &direction);
+    static QVector3D unpackDirection(float packed);
+
+signals:
+    void recordCountChanged(int recordCount);
+
+private:
+    QByteArray m_records;
+};
+
+#endif // GLYPHTEXTURE_H
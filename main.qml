@@ -79,44 +79,55 @@ ApplicationWindow {
             anchors.top: parent.top
             anchors.left: parent.left
             anchors.right: parent.right
-            ListView {
-                id: listView
-                model: meshInfo.subsetListModel
-                width: 100
-                height: 200
+            ColumnLayout {
+                ComboBox {
+                    id: meshIdComboBox
+                    Layout.preferredWidth: 100
+                    visible: meshInfo.meshIds.length > 1
+                    model: meshInfo.meshIds
+                    displayText: "Mesh " + currentText
+                    currentIndex: meshInfo.meshIndex
+                    onActivated: meshInfo.meshIndex = currentIndex
+                }
+                ListView {
+                    id: listView
+                    model: meshInfo.subsetListModel
+                    Layout.preferredWidth: 100
+                    Layout.preferredHeight: meshIdComboBox.visible ? 200 - meshIdComboBox.height : 200
 
-                clip: true
-                currentIndex: 0
-                ScrollIndicator.vertical: ScrollIndicator {}
-                delegate: ItemDelegate {
-                    text: subsetName === "" ? index : subsetName
-                    width: parent.width
-                    onClicked: {
-                        listView.currentIndex = index
+                    clip: true
+                    currentIndex: 0
+                    ScrollIndicator.vertical: ScrollIndicator {}
+                    delegate: ItemDelegate {
+                        text: subsetName === "" ? index : subsetName
+                        width: parent.width
+                        onClicked: {
+                            listView.currentIndex = index
+                        }
                     }
-                }
 
-                focus: true
-                highlight: Rectangle {
-                    color: "green"
-                    width: 100
-                    height: 25
-                }
-                header: Rectangle {
-                    width: 100
-                    height: 25
-                    color: "#333333"
-                    Text {
-                        anchors.centerIn: parent
-                        color: '#aaaaaa'
-                        text: "Subset"
-                        font.pixelSize: 16
+                    focus: true
+                    highlight: Rectangle {
+                        color: "green"
+                        width: 100
+                        height: 25
+                    }
+                    header: Rectangle {
+                        width: 100
+                        height: 25
+                        color: "#333333"
+                        Text {
+                            anchors.centerIn: parent
+                            color: '#aaaaaa'
+                            text: "Subset"
+                            font.pixelSize: 16
+                        }
                     }
-                }
 
-                onCurrentIndexChanged: {
-                    meshInfo.subsetDataTableModel.subsetIndex = currentIndex;
-                    console.log("current index: " + currentIndex)
+                    onCurrentIndexChanged: {
+                        meshInfo.subsetDataTableModel.subsetIndex = currentIndex;
+                        console.log("current index: " + currentIndex)
+                    }
                 }
             }
             Item {
@@ -145,7 +156,21 @@ ApplicationWindow {
 
                         Connections {
                             target: meshInfo.subsetDataTableModel
+                            function onSubsetIndexChanged() {
+                                tableView.selectedRow = -1;
+                            }
+                            // Reloads of the file keep the selected vertex when it still exists,
+                            // setting it again moves the marker to its new position
                             function onModelReset() {
+                                const row = tableView.selectedRow;
+                                tableView.selectedRow = -1;
+                                if (row < meshInfo.subsetDataTableModel.rowCount())
+                                    tableView.selectedRow = row;
+                            }
+                        }
+                        Connections {
+                            target: meshInfo
+                            function onMeshFileChanged() {
                                 tableView.selectedRow = -1;
                             }
                         }
@@ -357,22 +382,36 @@ ApplicationWindow {
                                 }
                                 CheckBox {
                                     id: normalsViewCheckBox
-                                    enabled: geometryGenerator.normals !== null
+                                    enabled: geometryGenerator.original !== null
                                     checked: false
                                     text: "Normals"
                                 }
                                 CheckBox {
                                     id: tangentsViewCheckBox
-                                    enabled: geometryGenerator.tangents !== null
+                                    enabled: geometryGenerator.hasTangents
                                     checked: false
                                     text: "Tangents"
                                 }
                                 CheckBox {
                                     id: binormalsViewCheckBox
-                                    enabled: geometryGenerator.binormals !== null
+                                    enabled: geometryGenerator.hasBinormals
                                     checked: false
                                     text: "Binormals"
                                 }
+                                RowLayout {
+                                    enabled: normalsViewCheckBox.checked || tangentsViewCheckBox.checked
+                                             || binormalsViewCheckBox.checked
+                                    Label {
+                                        text: "Glyph Length"
+                                    }
+                                    Slider {
+                                        id: glyphScaleSlider
+                                        from: 0.1
+                                        to: 10
+                                        value: 1.0
+                                        Layout.fillWidth: true
+                                    }
+                                }
                                 CheckBox {
                                     id: uvViewCheckBox
                                     checked: false
@@ -385,6 +424,12 @@ ApplicationWindow {
                                     text: "Vertex Colors"
                                 }
 
+                                CheckBox {
+                                    id: compactPreviewCheckBox
+                                    checked: false
+                                    text: "Compact Preview"
+                                }
+
                             }
                         }
                     }
@@ -431,11 +476,19 @@ ApplicationWindow {
                         id: originalModel
                         visible: geometryGenerator.original !== null && originalViewCheckBox.checked
                         geometry: geometryGenerator.original
-                        materials: PrincipledMaterial {
+                        materials: geometryGenerator.originalCompact ? compactOriginalMaterial : originalMaterial
+                        PrincipledMaterial {
+                            id: originalMaterial
                             baseColor: "grey"
                             metalness: 0.0
                             roughness: 0.3
                         }
+                        CompactPreviewMaterial {
+                            id: compactOriginalMaterial
+                            positionMin: geometryGenerator.originalBoundsMin
+                            positionExtent: geometryGenerator.originalBoundsMax.minus(geometryGenerator.originalBoundsMin)
+                            mode: 0
+                        }
                     }
                     Model {
                         id: wireframeModel
@@ -448,34 +501,46 @@ ApplicationWindow {
                         }
                     }
 
-                    Model {
+                    Repeater3D {
                         id: normalsModel
-                        visible: geometryGenerator.normals !== null && normalsViewCheckBox.checked
-                        geometry: geometryGenerator.normals
-                        materials: PrincipledMaterial {
-                            baseColor: "blue"
-                            cullMode: Material.NoCulling
-                            lighting: PrincipledMaterial.NoLighting
+                        model: geometryGenerator.normals !== null && normalsViewCheckBox.checked
+                               ? Math.ceil(geometryGenerator.normals.recordCount / geometryGenerator.glyphChunkSize) : 0
+                        Model {
+                            geometry: geometryGenerator.glyph
+                            materials: GlyphMaterial {
+                                records: geometryGenerator.normals
+                                firstRecord: index * geometryGenerator.glyphChunkSize
+                                glyphLength: geometryGenerator.glyphLength
+                                glyphColor: "blue"
+                            }
                         }
                     }
-                    Model {
+                    Repeater3D {
                         id: tangentsModel
-                        visible: geometryGenerator.tangents !== null && tangentsViewCheckBox.checked
-                        geometry: geometryGenerator.tangents
-                        materials: PrincipledMaterial {
-                            baseColor: "red"
-                            cullMode: Material.NoCulling
-                            lighting: PrincipledMaterial.NoLighting
+                        model: geometryGenerator.tangents !== null && tangentsViewCheckBox.checked
+                               ? Math.ceil(geometryGenerator.tangents.recordCount / geometryGenerator.glyphChunkSize) : 0
+                        Model {
+                            geometry: geometryGenerator.glyph
+                            materials: GlyphMaterial {
+                                records: geometryGenerator.tangents
+                                firstRecord: index * geometryGenerator.glyphChunkSize
+                                glyphLength: geometryGenerator.glyphLength
+                                glyphColor: "red"
+                            }
                         }
                     }
-                    Model {
+                    Repeater3D {
                         id: binormalsModel
-                        visible: geometryGenerator.binormals !== null && binormalsViewCheckBox.checked
-                        geometry: geometryGenerator.binormals
-                        materials: PrincipledMaterial {
-                            baseColor: "green"
-                            cullMode: Material.NoCulling
-                            lighting: PrincipledMaterial.NoLighting
+                        model: geometryGenerator.binormals !== null && binormalsViewCheckBox.checked
+                               ? Math.ceil(geometryGenerator.binormals.recordCount / geometryGenerator.glyphChunkSize) : 0
+                        Model {
+                            geometry: geometryGenerator.glyph
+                            materials: GlyphMaterial {
+                                records: geometryGenerator.binormals
+                                firstRecord: index * geometryGenerator.glyphChunkSize
+                                glyphLength: geometryGenerator.glyphLength
+                                glyphColor: "green"
+                            }
                         }
                     }
 
@@ -483,16 +548,30 @@ ApplicationWindow {
                         id: uvCheckerModel
                         visible: geometryGenerator.original !== null && uvViewCheckBox.checked
                         geometry: geometryGenerator.original
-                        materials: UvCheckerMaterial {
-
+                        materials: geometryGenerator.originalCompact ? compactUvCheckerMaterial : uvCheckerMaterial
+                        UvCheckerMaterial {
+                            id: uvCheckerMaterial
+                        }
+                        CompactPreviewMaterial {
+                            id: compactUvCheckerMaterial
+                            positionMin: geometryGenerator.originalBoundsMin
+                            positionExtent: geometryGenerator.originalBoundsMax.minus(geometryGenerator.originalBoundsMin)
+                            mode: 1
                         }
                     }
                     Model {
                         id: vertexColorModel
                         visible: geometryGenerator.original !== null && colorViewCheckBox.checked
                         geometry: geometryGenerator.original
-                        materials: VertexColorMaterial {
-
+                        materials: geometryGenerator.originalCompact ? compactVertexColorMaterial : vertexColorMaterial
+                        VertexColorMaterial {
+                            id: vertexColorMaterial
+                        }
+                        CompactPreviewMaterial {
+                            id: compactVertexColorMaterial
+                            positionMin: geometryGenerator.originalBoundsMin
+                            positionExtent: geometryGenerator.originalBoundsMax.minus(geometryGenerator.originalBoundsMin)
+                            mode: 2
                         }
                     }
                     Model {
@@ -514,6 +593,12 @@ ApplicationWindow {
                     id: geometryGenerator
                     meshInfo: meshInfo
                     subsetIndex: listView.currentIndex
+                    wireframeEnabled: wireframeViewCheckBox.checked
+                    normalsEnabled: normalsViewCheckBox.checked
+                    tangentsEnabled: tangentsViewCheckBox.checked
+                    binormalsEnabled: binormalsViewCheckBox.checked
+                    glyphScale: glyphScaleSlider.value
+                    compactPreview: compactPreviewCheckBox.checked
                 }
                 OrbitCameraController {
                     id: cameraController
@@ -522,10 +607,146 @@ ApplicationWindow {
                 }
 
                 DebugView {
+                    id: debugView
                     source: view3D
                     anchors.top: parent.top
                     anchors.right: parent.right
                 }
+
+                Rectangle {
+                    id: memoryPanel
+                    anchors.top: debugView.bottom
+                    anchors.right: parent.right
+                    anchors.topMargin: 4
+                    width: memoryLayout.implicitWidth + 20
+                    height: memoryLayout.implicitHeight + 20
+                    color: "#80000000"
+
+                    function formatBytes(bytes) {
+                        if (bytes === undefined)
+                            return "-"
+                        if (bytes >= 1024 * 1024 * 1024)
+                            return (bytes / (1024 * 1024 * 1024)).toFixed(2) + " GB"
+                        if (bytes >= 1024 * 1024)
+                            return (bytes / (1024 * 1024)).toFixed(2) + " MB"
+                        if (bytes >= 1024)
+                            return (bytes / 1024).toFixed(1) + " KB"
+                        return bytes + " B"
+                    }
+
+                    ColumnLayout {
+                        id: memoryLayout
+                        anchors.centerIn: parent
+                        spacing: 2
+
+                        Repeater {
+                            model: [
+                                { label: qsTr("Raw buffers"), key: "rawBuffers" },
+                                { label: qsTr("Mapped file"), key: "mappedFile" },
+                                { label: qsTr("Decoded attributes"), key: "decodedAttributes" },
+                                { label: qsTr("Overlay geometry"), key: "overlayGeometry" },
+                                { label: qsTr("Model caches"), key: "modelCaches" },
+                                { label: qsTr("Total"), key: "total" }
+                            ]
+                            delegate: RowLayout {
+                                required property var modelData
+                                spacing: 10
+                                Label {
+                                    text: modelData.label
+                                    color: "white"
+                                    font.bold: modelData.key === "total"
+                                    Layout.fillWidth: true
+                                }
+                                Label {
+                                    text: memoryPanel.formatBytes(meshInfo.memoryUsage[modelData.key])
+                                    color: "white"
+                                    font.bold: modelData.key === "total"
+                                    horizontalAlignment: Text.AlignRight
+                                    Layout.preferredWidth: 80
+                                }
+                            }
+                        }
+
+                        RowLayout {
+                            spacing: 10
+                            Label {
+                                text: qsTr("Geometry cache")
+                                color: "white"
+                                Layout.fillWidth: true
+                            }
+                            Label {
+                                text: memoryPanel.formatBytes(geometryGenerator.cacheSize) + " ("
+                                      + geometryGenerator.cacheHits + " / " + geometryGenerator.cacheMisses + ")"
+                                color: "white"
+                                horizontalAlignment: Text.AlignRight
+                                Layout.preferredWidth: 140
+                            }
+                        }
+
+                        RowLayout {
+                            spacing: 10
+                            visible: geometryGenerator.weldedVertexCount > 0
+                            Label {
+                                text: qsTr("Welded vertexes")
+                                color: "white"
+                                Layout.fillWidth: true
+                            }
+                            Label {
+                                text: geometryGenerator.weldedVertexCount + " / " + geometryGenerator.sourceVertexCount + " ("
+                                      + (geometryGenerator.sourceVertexCount / geometryGenerator.weldedVertexCount).toFixed(1) + "x)"
+                                color: "white"
+                                horizontalAlignment: Text.AlignRight
+                                Layout.preferredWidth: 140
+                            }
+                        }
+
+                        // Largest decode errors of the compact layout
+                        Repeater {
+                            model: [
+                                { label: qsTr("Position error"), key: "position", unit: "" },
+                                { label: qsTr("Normal error"), key: "normal", unit: "°" },
+                                { label: qsTr("UV0 error"), key: "uv", unit: "" },
+                                { label: qsTr("Color error"), key: "color", unit: "" }
+                            ]
+                            delegate: RowLayout {
+                                required property var modelData
+                                readonly property var error: geometryGenerator.precisionReport[modelData.key]
+                                spacing: 10
+                                visible: error !== undefined
+                                Label {
+                                    text: modelData.label
+                                    color: "white"
+                                    Layout.fillWidth: true
+                                }
+                                Label {
+                                    text: error !== undefined ? error.toPrecision(3) + modelData.unit : "-"
+                                    color: "white"
+                                    horizontalAlignment: Text.AlignRight
+                                    Layout.preferredWidth: 80
+                                }
+                            }
+                        }
+                    }
+                }
+
+                ColumnLayout {
+                    id: loadingIndicator
+                    anchors.centerIn: parent
+                    visible: meshInfo.loading
+                    Label {
+                        text: qsTr("Loading") + " " + meshInfo.meshName
+                        Layout.alignment: Qt.AlignHCenter
+                    }
+                    ProgressBar {
+                        value: meshInfo.progress
+                        Layout.preferredWidth: 300
+                    }
+                    Button {
+                        text: qsTr("Cancel")
+                        Layout.alignment: Qt.AlignHCenter
+                        onClicked: meshInfo.cancel()
+                    }
+                }
             }
         }
     }
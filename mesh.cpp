@@ -25,9 +25,146 @@
  */
 
 #include "mesh.h"
+#include "attributedecoder.h"
+#include "diskcache.h"
+#include "tracing.h"
 #include <QFile>
+#include <QFileInfo>
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QSaveFile>
 #include <QDataStream>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <QtConcurrent/QtConcurrentMap>
+
+#if defined(Q_OS_UNIX)
+#include <sys/mman.h>
+#endif
+
+namespace {
+// Name of the trace span of decoding an attribute
+const char *decodeSpanName(Mesh::AttributeSemantic semantic)
+{
+    switch (semantic) {
+    case Mesh::PositionSemantic: return "decode positions";
+    case Mesh::NormalSemantic: return "decode normals";
+    case Mesh::TexCoordSemantic: return "decode uvs";
+    case Mesh::TangentSemantic: return "decode tangents";
+    case Mesh::BinormalSemantic: return "decode binormals";
+    case Mesh::ColorSemantic: return "decode colors";
+    case Mesh::JointSemantic: return "decode joints";
+    case Mesh::WeightSemantic: return "decode weights";
+    case Mesh::MorphTargetPositionSemantic: return "decode morph target positions";
+    case Mesh::MorphTargetNormalSemantic: return "decode morph target normals";
+    case Mesh::MorphTargetTangentSemantic: return "decode morph target tangents";
+    case Mesh::MorphTargetBinormalSemantic: return "decode morph target binormals";
+    case Mesh::UnknownSemantic: break;
+    }
+    return "decode attribute";
+}
+
+// Integer data of these semantics stores normalized values
+bool isNormalizedSemantic(Mesh::AttributeSemantic semantic)
+{
+    switch (semantic) {
+    case Mesh::PositionSemantic:
+    case Mesh::JointSemantic:
+    case Mesh::MorphTargetPositionSemantic:
+    case Mesh::UnknownSemantic:
+        return false;
+    default:
+        return true;
+    }
+}
+
+template <typename T>
+void addHashValue(QCryptographicHash &hash, const T &value)
+{
+    hash.addData(QByteArrayView(reinterpret_cast<const char *>(&value), sizeof(value)));
+}
+
+// Compares whatever is written to it against bytes in memory, so a mesh
+// can be checked against its mapped file without writing out a copy
+class CompareDevice : public QIODevice
+{
+public:
+    CompareDevice(const char *data, qint64 size) : m_data(data), m_size(size) {}
+
+    bool isSequential() const override { return false; }
+    qint64 size() const override { return m_size; }
+    bool matches() const { return m_mismatches.isEmpty(); }
+    // End of the furthest write
+    qint64 end() const { return m_end; }
+
+protected:
+    qint64 readData(char *, qint64) override { return -1; }
+    qint64 writeData(const char *data, qint64 length) override
+    {
+        const qint64 position = pos();
+        m_end = qMax(m_end, position + length);
+        if (position + length > m_size || memcmp(m_data + position, data, length) != 0) {
+            m_mismatches.append({ position, position + length });
+            return length;
+        }
+        // Placeholders that are patched later, like the mesh size, only
+        // count when they stay different
+        m_mismatches.removeIf([position, length](const QPair<qint64, qint64> &range) {
+            return range.first >= position && range.second <= position + length;
+        });
+        return length;
+    }
+
+private:
+    const char *m_data;
+    qint64 m_size;
+    qint64 m_end = 0;
+    QVector<QPair<qint64, qint64>> m_mismatches;
+};
+}
+
+MeshFileMapping::MeshFileMapping(const QString &meshFile)
+    : m_file(meshFile)
+{
+    TraceSpan span("map file");
+    if (!m_file.open(QIODevice::ReadOnly))
+        return;
+
+    m_size = m_file.size();
+    if (m_size > 0)
+        m_data = m_file.map(0, m_size);
+}
+
+MeshFileMapping::~MeshFileMapping()
+{
+    if (m_data)
+        m_file.unmap(m_data);
+    m_file.close();
+}
+
+void MeshFileMapping::detach()
+{
+    if (!m_data || m_detached.exchange(true))
+        return;
+
+#if defined(Q_OS_UNIX)
+    // Anonymous pages over the same range, so unmap() still releases it
+    if (mmap(m_data, size_t(m_size), PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+        qWarning() << "Could not detach the mapping of" << m_file.fileName();
+#endif
+    // Windows does not let the file be truncated while it is mapped
+}
 
+QSharedPointer<MeshFileMapping> MeshFileMapping::map(const QString &meshFile)
+{
+    QSharedPointer<MeshFileMapping> mapping(new MeshFileMapping(meshFile));
+    if (!mapping->m_data)
+        return QSharedPointer<MeshFileMapping>();
+    return mapping;
+}
 
 Mesh::Mesh()
 {
@@ -39,14 +176,72 @@ Mesh::~Mesh()
     qDeleteAll(m_subsets);
 }
 
-quint64 Mesh::loadMesh(const QString &meshFile, quint64 offset)
+quint64 Mesh::loadMesh(const QString &meshFile, quint64 offset, const ProgressCallback &progressCallback)
 {
+    TraceSpan span("open file");
     QFile file(meshFile);
     if (!file.open(QIODevice::ReadOnly)) {
         qWarning() << "Unable to load mesh in file: " << meshFile;
         return 0;
     }
+    span.next("load mesh");
 
+    const quint64 result = readMesh(file, offset, nullptr, progressCallback);
+    file.close();
+    return result;
+}
+
+quint64 Mesh::loadMesh(const QSharedPointer<MeshFileMapping> &mapping, quint64 offset,
+                       const ProgressCallback &progressCallback)
+{
+    if (!mapping)
+        return 0;
+
+    // QBuffer over raw data does not copy, so the tables are parsed
+    // straight out of the mapping
+    QBuffer buffer;
+    buffer.setData(QByteArray::fromRawData(mapping->data(), mapping->size()));
+    buffer.open(QIODevice::ReadOnly);
+
+    m_mapping = mapping;
+    const quint64 result = readMesh(buffer, offset, nullptr, progressCallback);
+    if (result == 0)
+        m_mapping.reset();
+    return result;
+}
+
+QByteArray Mesh::readSection(QIODevice &device, quint32 size, const std::function<bool(qint64)> &progress)
+{
+    if (!m_mapping) {
+        // Read in chunks, a large section reports progress and can be canceled
+        static const qint64 chunkSize = 16 * 1024 * 1024;
+        QByteArray data(size, Qt::Uninitialized);
+        qint64 read = 0;
+        while (read < size) {
+            const qint64 length = device.read(data.data() + read, qMin(chunkSize, qint64(size) - read));
+            if (length <= 0)
+                break;
+            read += length;
+            if (progress && !progress(read))
+                break;
+        }
+        data.resize(read);
+        return data;
+    }
+
+    // Reference the mapped bytes instead of copying them
+    const qint64 position = device.pos();
+    const qint64 available = qMax(qint64(0), m_mapping->size() - position);
+    const qint64 length = qMin(qint64(size), available);
+    device.seek(position + length);
+    return QByteArray::fromRawData(m_mapping->data() + position, length);
+}
+
+quint64 Mesh::readMesh(QIODevice &file, quint64 offset, MeshSummary *summary,
+                       const ProgressCallback &progressCallback)
+{
+    TraceSpan span("mesh header");
+    m_fileOffset = offset;
     file.seek(offset);
     QDataStream inputStream(&file);
     inputStream.setByteOrder(QDataStream::LittleEndian);
@@ -54,7 +249,6 @@ quint64 Mesh::loadMesh(const QString &meshFile, quint64 offset)
     inputStream >> m_meshInfo.fileId >> m_meshInfo.fileVersion >> m_meshInfo.headerFlags >> m_meshInfo.sizeInBytes;
 
     if (!m_meshInfo.isValid()) {
-        file.close();
         qWarning() << "Mesh data invalid";
         return 0;
     }
@@ -62,33 +256,40 @@ quint64 Mesh::loadMesh(const QString &meshFile, quint64 offset)
     MeshOffsetTracker offsetTracker(offset + 12);
     file.seek(offsetTracker.offset());
 
+    // Reported after every section, and while large sections are streamed
+    const qint64 bytesTotal = 12 + qint64(m_meshInfo.sizeInBytes);
+    bool canceled = false;
+    auto reportProgress = [&](qint64 sectionBytesRead) {
+        if (progressCallback && !canceled
+                && !progressCallback(qMin(bytesTotal, 12 + qint64(offsetTracker.byteCounter) + sectionBytesRead),
+                                     bytesTotal)) {
+            canceled = true;
+        }
+        return !canceled;
+    };
+
     // Vertex Buffer
-    quint32 vertexBufferEntriesOffset;
     quint32 vertexBufferEntiresSize;
-    quint32 vertexBufferDataOffset;
     quint32 vertexBufferDataSize;
-    inputStream >> vertexBufferEntriesOffset
+    inputStream >> m_sectionOffsets.vertexBufferEntries
                 >> vertexBufferEntiresSize
                 >> m_vertexBuffer.stride
-                >> vertexBufferDataOffset
+                >> m_sectionOffsets.vertexBufferData
                 >> vertexBufferDataSize;
     // Index Buffer
     quint32 indexBufferComponentType;
-    quint32 indexBufferOffset;
     quint32 indexBufferSize;
     inputStream >> indexBufferComponentType
-                >> indexBufferOffset
+                >> m_sectionOffsets.indexBuffer
                 >> indexBufferSize;
     m_indexBuffer.componentType = ComponentType(indexBufferComponentType);
     // Subsets
-    quint32 subsetsOffsets;
     quint32 subsetsSize;
-    inputStream >> subsetsOffsets >> subsetsSize;
+    inputStream >> m_sectionOffsets.subsets >> subsetsSize;
 
     // Joints
-    quint32 jointsOffsets;
     quint32 jointsSize;
-    inputStream >> jointsOffsets >> jointsSize;
+    inputStream >> m_sectionOffsets.joints >> jointsSize;
 
     quint32 drawMode;
     quint32 windingMode;
@@ -100,12 +301,12 @@ quint64 Mesh::loadMesh(const QString &meshFile, quint64 offset)
     offsetTracker.advance(56);
 
     // Vertex Buffer Entries
+    span.next("vertex entries");
     quint32 entriesByteSize = 0;
     for (int i = 0; i < vertexBufferEntiresSize; ++i) {
         VertexBufferEntry vertexBufferEntry;
         quint32 componentType;
-        quint32 nameOffset; // ignored
-        inputStream >> nameOffset
+        inputStream >> vertexBufferEntry.nameOffset
                     >> componentType
                     >> vertexBufferEntry.numComponents
                     >> vertexBufferEntry.firstItemOffset;
@@ -116,6 +317,7 @@ quint64 Mesh::loadMesh(const QString &meshFile, quint64 offset)
     offsetTracker.alignedAdvance(entriesByteSize);
     file.seek(offsetTracker.offset());
     // Get the names of the vertex entries
+    span.next("vertex entry names");
     for (auto &entry : m_vertexBuffer.entires) {
         quint32 nameLength;
         inputStream >> nameLength;
@@ -125,18 +327,29 @@ quint64 Mesh::loadMesh(const QString &meshFile, quint64 offset)
         file.seek(offsetTracker.offset());
     }
 
-    // Vertex Buffer Data
-    m_vertexBuffer.data = file.read(vertexBufferDataSize);
+    buildVertexLayout();
+
+    // Vertex Buffer Data, a summary only needs the sizes of the data sections
+    span.next("vertex data");
+    if (!summary)
+        m_vertexBuffer.data = readSection(file, vertexBufferDataSize, reportProgress);
     offsetTracker.alignedAdvance(vertexBufferDataSize);
     file.seek(offsetTracker.offset());
+    if (!reportProgress(0))
+        return 0;
 
     // Index Buffer Data
-    m_indexBuffer.data = file.read(indexBufferSize);
+    span.next("index data");
+    if (!summary)
+        m_indexBuffer.data = readSection(file, indexBufferSize, reportProgress);
     offsetTracker.alignedAdvance(indexBufferSize);
     file.seek(offsetTracker.offset());
+    if (!reportProgress(0))
+        return 0;
 
 
     // Subsets
+    span.next("subsets");
     quint32 subsetByteSize = 0;
     for (int i = 0; i < subsetsSize; ++i) {
         MeshSubset subset;
@@ -146,7 +359,6 @@ quint64 Mesh::loadMesh(const QString &meshFile, quint64 offset)
         float maxX;
         float maxY;
         float maxZ;
-        quint32 nameOffset;
         inputStream >> subset.count
                     >> subset.offset
                     >> minX
@@ -155,7 +367,7 @@ quint64 Mesh::loadMesh(const QString &meshFile, quint64 offset)
                     >> maxX
                     >> maxY
                     >> maxZ
-                    >> nameOffset
+                    >> subset.nameOffset
                     >> subset.nameLength;
         subset.bounds.min = QVector3D(minX, minY, minZ);
         subset.bounds.max = QVector3D(maxX, maxY, maxZ);
@@ -167,13 +379,17 @@ quint64 Mesh::loadMesh(const QString &meshFile, quint64 offset)
     file.seek(offsetTracker.offset());
 
     // Subset names
+    span.next("subset names");
     for (auto &subset : m_meshSubsets) {
         subset.name = file.read(subset.nameLength * 2); //UTF_16_le
         offsetTracker.alignedAdvance(subset.nameLength * 2);
         file.seek(offsetTracker.offset());
     }
+    if (!reportProgress(0))
+        return 0;
 
     // Joints
+    span.next("joints");
     for (int i = 0; i < jointsSize; ++i) {
         Joint joint;
         inputStream >> joint.jointId >> joint.parentId;
@@ -190,45 +406,627 @@ quint64 Mesh::loadMesh(const QString &meshFile, quint64 offset)
         m_joints.append(joint);
     }
 
-    file.close();
+    if (summary) {
+        summary->fileVersion = m_meshInfo.fileVersion;
+        summary->sizeInBytes = m_meshInfo.sizeInBytes;
+        summary->stride = m_vertexBuffer.stride;
+        summary->vertexDataSize = vertexBufferDataSize;
+        summary->indexComponentType = m_indexBuffer.componentType;
+        summary->indexDataSize = indexBufferSize;
+        summary->drawMode = m_drawMode;
+        summary->windingMode = m_windingMode;
+        for (const auto &entry : m_vertexBuffer.entires)
+            summary->attributeNames.append(entry.name);
+        summary->vertexLayout = m_vertexLayout;
+        for (const auto &subset : m_meshSubsets) {
+            MeshSummary::SubsetSummary subsetSummary;
+            subsetSummary.name = QString::fromUtf16(reinterpret_cast<const char16_t *>(subset.name.constData()),
+                                                    subset.name.size() / 2);
+            while (subsetSummary.name.endsWith(QChar::Null))
+                subsetSummary.name.chop(1);
+            subsetSummary.count = subset.count;
+            subsetSummary.offset = subset.offset;
+            subsetSummary.bounds.min = subset.bounds.min;
+            subsetSummary.bounds.max = subset.bounds.max;
+            summary->subsets.append(subsetSummary);
+        }
+        summary->jointCount = m_joints.count();
+        return m_meshInfo.sizeInBytes;
+    }
+
+    span.next("create subsets");
+    createSubsets();
+    reportProgress(bytesTotal);
+
+    return m_meshInfo.sizeInBytes;
+}
+
+void Mesh::buildVertexLayout()
+{
+    struct AttributeName {
+        QByteArrayView name;
+        AttributeSemantic semantic;
+        bool hasChannel; // name is followed by the channel number
+    };
+    // Prefixes of morph targets overlap with "attr_textan", so exact names go first
+    static const AttributeName attributeNames[] = {
+        { "attr_pos", PositionSemantic, false },
+        { "attr_norm", NormalSemantic, false },
+        { "attr_textan", TangentSemantic, false },
+        { "attr_binormal", BinormalSemantic, false },
+        { "attr_color", ColorSemantic, false },
+        { "attr_joints", JointSemantic, false },
+        { "attr_weights", WeightSemantic, false },
+        { "attr_uv", TexCoordSemantic, true },
+        { "attr_tpos", MorphTargetPositionSemantic, true },
+        { "attr_tnorm", MorphTargetNormalSemantic, true },
+        { "attr_ttan", MorphTargetTangentSemantic, true },
+        { "attr_tbinorm", MorphTargetBinormalSemantic, true }
+    };
+
+    m_vertexLayout.clear();
+    m_vertexLayout.reserve(m_vertexBuffer.entires.count());
+    for (const auto &entry : m_vertexBuffer.entires) {
+        VertexAttribute attribute;
+        attribute.componentType = entry.componentType;
+        attribute.numComponents = entry.numComponents;
+        attribute.offset = entry.firstItemOffset;
+
+        // Names are stored with their null terminator
+        QByteArrayView name(entry.name);
+        while (name.endsWith('\0'))
+            name.chop(1);
+
+        for (const auto &attributeName : attributeNames) {
+            if (!attributeName.hasChannel) {
+                if (name == attributeName.name) {
+                    attribute.semantic = attributeName.semantic;
+                    break;
+                }
+                continue;
+            }
+            if (name.startsWith(attributeName.name)) {
+                bool ok = false;
+                const int channel = name.sliced(attributeName.name.size()).toInt(&ok);
+                if (ok) {
+                    attribute.semantic = attributeName.semantic;
+                    attribute.channel = channel;
+                    break;
+                }
+            }
+        }
+
+        if (attribute.semantic == UnknownSemantic)
+            qWarning() << "Unknown vertex attribute" << name.toByteArray();
+        m_vertexLayout.append(attribute);
+    }
+}
+
+const Mesh::VertexAttribute *Mesh::findAttribute(AttributeSemantic semantic, int channel) const
+{
+    for (const auto &attribute : m_vertexLayout) {
+        if (attribute.semantic == semantic && attribute.channel == channel)
+            return &attribute;
+    }
+    return nullptr;
+}
+
+QStringList Mesh::validate() const
+{
+    QStringList errors;
+
+    // Vertex layout
+    const quint32 stride = m_vertexBuffer.stride;
+    for (int i = 0; i < m_vertexBuffer.entires.count(); ++i) {
+        const auto &entry = m_vertexBuffer.entires.at(i);
+        const QString name = QString::fromLatin1(entry.name).remove(QChar::Null);
+        if (!AttributeDecoder::isSupported(entry.componentType) || entry.numComponents < 1 || entry.numComponents > 4) {
+            errors.append(QStringLiteral("attribute %1 has an unsupported format").arg(name));
+            continue;
+        }
+        const quint32 size = AttributeDecoder::componentSize(entry.componentType) * entry.numComponents;
+        if (entry.firstItemOffset + size > stride)
+            errors.append(QStringLiteral("attribute %1 does not fit in the vertex stride").arg(name));
+    }
+    if (stride > 0 && m_vertexBuffer.data.size() % stride != 0)
+        errors.append(QStringLiteral("vertex data is not a multiple of the stride"));
+
+    // Indexes
+    if (m_indexBuffer.componentType != ComponentType::UnsignedInt16
+            && m_indexBuffer.componentType != ComponentType::UnsignedInt32) {
+        errors.append(QStringLiteral("index buffer has an unsupported component type %1")
+                      .arg(int(m_indexBuffer.componentType)));
+    }
+    const quint32 vertexCount = stride > 0 ? m_vertexBuffer.data.size() / stride : 0;
+    const quint32 *indexes = indexData();
+    const quint32 totalIndexes = indexCount();
+    quint32 outOfRange = 0;
+    for (quint32 i = 0; i < totalIndexes; ++i) {
+        if (indexes[i] >= vertexCount)
+            ++outOfRange;
+    }
+    if (outOfRange > 0)
+        errors.append(QStringLiteral("%1 indexes reference vertices past the end of the vertex data").arg(outOfRange));
+
+    // Subsets, and the decode kernels against the reference decoder. A
+    // chunk of the indexes at a time, so large subsets need little memory.
+    static const quint32 chunkSize = 65536;
+    QVector<float> decoded(chunkSize * 4);
+    QVector<float> reference(chunkSize * 4);
+    for (int i = 0; i < m_meshSubsets.count(); ++i) {
+        const auto &subset = m_meshSubsets.at(i);
+        if (quint64(subset.offset) + subset.count > totalIndexes) {
+            errors.append(QStringLiteral("subset %1 references indexes past the end of the index buffer").arg(i));
+            continue;
+        }
+        for (const auto &attribute : m_vertexLayout) {
+            AttributeDecoder::Source source;
+            source.data = m_vertexBuffer.data.constData();
+            source.size = m_vertexBuffer.data.size();
+            source.stride = stride;
+            source.offset = attribute.offset;
+            source.componentType = attribute.componentType;
+            source.numComponents = attribute.numComponents;
+            source.normalized = isNormalizedSemantic(attribute.semantic);
+            bool mismatch = false;
+            for (quint32 first = 0; first < subset.count && !mismatch; first += chunkSize) {
+                const quint32 count = qMin(chunkSize, subset.count - first);
+                const quint32 *chunk = indexes + subset.offset + first;
+                if (!AttributeDecoder::decode(source, chunk, count, decoded.data(), 4))
+                    break;
+                AttributeDecoder::decodeReference(source, chunk, count, reference.data(), 4);
+                for (quint32 j = 0; j < count * 4; ++j) {
+                    const float a = decoded.at(j);
+                    const float b = reference.at(j);
+                    if (a != b && !(qIsNaN(a) && qIsNaN(b)) && qAbs(a - b) > qAbs(b) * 1e-6f) {
+                        mismatch = true;
+                        break;
+                    }
+                }
+            }
+            if (mismatch)
+                errors.append(QStringLiteral("subset %1 decodes differently from the reference decoder").arg(i));
+        }
+    }
+
+    return errors;
+}
+
+bool Mesh::roundTrips() const
+{
+    if (!m_mapping)
+        return false;
+    // Written straight into the comparison, nothing is buffered
+    CompareDevice device(m_mapping->data() + m_fileOffset, m_mapping->size() - qint64(m_fileOffset));
+    device.open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+    const quint64 size = writeMesh(device);
+    return size > 0 && device.matches() && device.end() == qint64(size) + 12;
+}
+
+void Mesh::createSubsets()
+{
+    // Index widening is done once for the whole mesh, subsets only read their range
+    if (m_indexBuffer.componentType == ComponentType::UnsignedInt16) {
+        const quint16 *p = reinterpret_cast<const quint16 *>(m_indexBuffer.data.constData());
+        const int length = m_indexBuffer.data.size() / sizeof(quint16);
+        m_widenedIndexes.resize(length);
+        for (int i = 0; i < length; ++i)
+            m_widenedIndexes[i] = quint32(p[i]);
+    } else if (m_indexBuffer.componentType != ComponentType::UnsignedInt32) {
+        // The raw bytes are kept for saving and hashing, indexCount() is 0
+        qWarning() << "Unsupported index component type" << m_indexBuffer.componentType;
+    }
+
+    // The layout is shared by all subsets and does not read the buffers,
+    // the subsets hash their own data on first use
+    QCryptographicHash layoutHash(QCryptographicHash::Sha1);
+    addHashValue(layoutHash, quint32(m_drawMode));
+    addHashValue(layoutHash, quint32(m_windingMode));
+    addHashValue(layoutHash, m_vertexBuffer.stride);
+    for (const auto &entry : m_vertexBuffer.entires) {
+        addHashValue(layoutHash, quint32(entry.componentType));
+        addHashValue(layoutHash, entry.numComponents);
+        addHashValue(layoutHash, entry.firstItemOffset);
+        layoutHash.addData(entry.name);
+    }
+    // Indexes past the end decode differently once the buffer grows
+    addHashValue(layoutHash, quint64(m_vertexBuffer.data.size()));
+    addHashValue(layoutHash, quint32(m_indexBuffer.componentType));
+    m_layoutHash = layoutHash.result();
 
     // Generate Subset Data
     for (int i = 0; i < m_meshSubsets.count(); ++i) {
         auto subset = new Subset(*this, i);
         m_subsets.append(subset);
     }
+}
+
+qint64 Mesh::rawBufferBytes() const
+{
+    qint64 bytes = m_widenedIndexes.size() * sizeof(quint32);
+    if (!m_mapping)
+        bytes += m_vertexBuffer.data.size() + m_indexBuffer.data.size();
+    for (const auto &entry : m_vertexBuffer.entires)
+        bytes += sizeof(VertexBufferEntry) + entry.name.size();
+    for (const auto &subset : m_meshSubsets)
+        bytes += sizeof(MeshSubset) + subset.name.size();
+    bytes += m_joints.size() * sizeof(Joint);
+    bytes += m_vertexLayout.size() * sizeof(VertexAttribute);
+    return bytes;
+}
+
+qint64 Mesh::mappedBytes() const
+{
+    if (!m_mapping)
+        return 0;
+    return m_vertexBuffer.data.size() + m_indexBuffer.data.size();
+}
+
+qint64 Mesh::decodedBytes() const
+{
+    qint64 bytes = 0;
+    for (const Subset *subset : m_subsets)
+        bytes += sizeof(Subset) + subset->decodedBytes();
+    return bytes;
+}
+
+QByteArray Mesh::contentHash() const
+{
+    if (!m_contentHash.isEmpty() || isDetached())
+        return m_contentHash;
+
+    QCryptographicHash meshHash(QCryptographicHash::Sha1);
+    meshHash.addData(m_layoutHash);
+    for (const Subset *subset : m_subsets) {
+        const QByteArray subsetHash = subset->contentHash();
+        // Hashed partly from a file that was changing
+        if (subsetHash.isEmpty())
+            return QByteArray();
+        meshHash.addData(subsetHash);
+    }
+    m_contentHash = meshHash.result();
+    return m_contentHash;
+}
 
-    return m_meshInfo.sizeInBytes;
+const quint32 *Mesh::indexData() const
+{
+    if (m_indexBuffer.componentType == ComponentType::UnsignedInt16)
+        return m_widenedIndexes.constData();
+    // 32bit indexes are read in place
+    return reinterpret_cast<const quint32 *>(m_indexBuffer.data.constData());
 }
 
-quint64 Mesh::saveMesh(const QString &meshFile, quint64 offset)
+quint32 Mesh::indexCount() const
 {
+    if (m_indexBuffer.componentType == ComponentType::UnsignedInt16)
+        return m_widenedIndexes.size();
+    if (m_indexBuffer.componentType == ComponentType::UnsignedInt32)
+        return m_indexBuffer.data.size() / sizeof(quint32);
     return 0;
 }
 
+quint64 Mesh::saveMesh(const QString &meshFile, quint64 offset)
+{
+    QFile file(meshFile);
+    if (!file.open(QIODevice::ReadWrite)) {
+        qWarning() << "Unable to save mesh in file: " << meshFile;
+        return 0;
+    }
+
+    file.seek(offset);
+    const quint64 result = writeMesh(file);
+    file.close();
+    return result;
+}
+
+quint64 Mesh::writeMesh(QIODevice &file) const
+{
+    // Sizes and offsets within a mesh entry are 32 bit, this is an upper
+    // bound of the size with every section padded
+    quint64 maxSize = 56 + 4 + m_vertexBuffer.entires.count() * 16 + 4;
+    for (const auto &entry : m_vertexBuffer.entires)
+        maxSize += 4 + entry.name.size() + 4;
+    maxSize += m_vertexBuffer.data.size() + 4 + m_indexBuffer.data.size() + 4;
+    maxSize += m_meshSubsets.count() * 40 + 4;
+    for (const auto &subset : m_meshSubsets)
+        maxSize += subset.nameLength * 2 + 4;
+    maxSize += m_joints.count() * (136 + 4);
+    if (maxSize > std::numeric_limits<quint32>::max()) {
+        qWarning() << "Mesh data is too large for a mesh entry:" << maxSize << "bytes";
+        return 0;
+    }
+
+    const qint64 startPosition = file.pos();
+    QDataStream outputStream(&file);
+    outputStream.setByteOrder(QDataStream::LittleEndian);
+    outputStream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    // Mirrors readMesh(), sections are padded to where the offset tracker
+    // says the next one starts
+    MeshOffsetTracker offsetTracker(startPosition + 12);
+    auto writePadding = [&]() {
+        static const char zeros[4] = {};
+        const qint64 target = startPosition + 12 + offsetTracker.byteCounter;
+        if (target > file.pos())
+            file.write(zeros, target - file.pos());
+    };
+    // Large sections are written straight from the (possibly mapped) buffers
+    auto writeSection = [&](const QByteArray &data, quint32 size) {
+        static const qint64 chunkSize = 4 * 1024 * 1024;
+        const qint64 length = qMin(qint64(data.size()), qint64(size));
+        for (qint64 written = 0; written < length; written += chunkSize)
+            file.write(data.constData() + written, qMin(chunkSize, length - written));
+        for (qint64 missing = size - length; missing > 0; --missing)
+            file.putChar(0);
+    };
+
+    // The size is patched in once everything has been written
+    outputStream << m_meshInfo.fileId << m_meshInfo.fileVersion << m_meshInfo.headerFlags << quint32(0);
+
+    outputStream << m_sectionOffsets.vertexBufferEntries
+                 << quint32(m_vertexBuffer.entires.count())
+                 << m_vertexBuffer.stride
+                 << m_sectionOffsets.vertexBufferData
+                 << quint32(m_vertexBuffer.data.size());
+    outputStream << quint32(m_indexBuffer.componentType)
+                 << m_sectionOffsets.indexBuffer
+                 << quint32(m_indexBuffer.data.size());
+    outputStream << m_sectionOffsets.subsets << quint32(m_meshSubsets.count());
+    outputStream << m_sectionOffsets.joints << quint32(m_joints.count());
+    outputStream << quint32(m_drawMode) << quint32(m_windingMode);
+    offsetTracker.advance(56);
+
+    // Vertex Buffer Entries
+    for (const auto &entry : m_vertexBuffer.entires) {
+        outputStream << entry.nameOffset
+                     << quint32(entry.componentType)
+                     << entry.numComponents
+                     << entry.firstItemOffset;
+    }
+    offsetTracker.alignedAdvance(m_vertexBuffer.entires.count() * 16);
+    writePadding();
+    for (const auto &entry : m_vertexBuffer.entires) {
+        outputStream << quint32(entry.name.size());
+        offsetTracker.advance(4);
+        writeSection(entry.name, entry.name.size());
+        offsetTracker.alignedAdvance(entry.name.size());
+        writePadding();
+    }
+
+    // Vertex Buffer Data
+    writeSection(m_vertexBuffer.data, m_vertexBuffer.data.size());
+    offsetTracker.alignedAdvance(m_vertexBuffer.data.size());
+    writePadding();
+
+    // Index Buffer Data
+    writeSection(m_indexBuffer.data, m_indexBuffer.data.size());
+    offsetTracker.alignedAdvance(m_indexBuffer.data.size());
+    writePadding();
+
+    // Subsets
+    for (const auto &subset : m_meshSubsets) {
+        outputStream << subset.count
+                     << subset.offset
+                     << subset.bounds.min.x()
+                     << subset.bounds.min.y()
+                     << subset.bounds.min.z()
+                     << subset.bounds.max.x()
+                     << subset.bounds.max.y()
+                     << subset.bounds.max.z()
+                     << subset.nameOffset
+                     << subset.nameLength;
+    }
+    offsetTracker.alignedAdvance(m_meshSubsets.count() * 40);
+    writePadding();
+
+    // Subset names
+    for (const auto &subset : m_meshSubsets) {
+        writeSection(subset.name, subset.nameLength * 2);
+        offsetTracker.alignedAdvance(subset.nameLength * 2);
+        writePadding();
+    }
+
+    // Joints
+    for (const auto &joint : m_joints) {
+        outputStream << joint.jointId << joint.parentId;
+        float values[16];
+        joint.invBindPos.copyDataTo(values);
+        for (int j = 0; j < 16; ++j)
+            outputStream << values[j];
+        joint.localToGlobalBoneSpace.copyDataTo(values);
+        for (int j = 0; j < 16; ++j)
+            outputStream << values[j];
+        offsetTracker.alignedAdvance(136);
+        writePadding();
+    }
+
+    if (outputStream.status() != QDataStream::Ok || !file.seek(startPosition + 8)) {
+        qWarning() << "Failed to write mesh data";
+        return 0;
+    }
+
+    // Size of everything following the header
+    const quint32 sizeInBytes = offsetTracker.byteCounter;
+    outputStream << sizeInBytes;
+    file.seek(startPosition + 12 + sizeInBytes);
+    return sizeInBytes;
+}
+
 MeshFileTool::MeshFileTool()
 {
 
 }
 
-QVector<Mesh *> MeshFileTool::loadMeshFile(const QString &meshFile)
+QThreadPool *MeshFileTool::threadPool() const
+{
+    return m_threadPool;
+}
+
+void MeshFileTool::setThreadPool(QThreadPool *threadPool)
+{
+    m_threadPool = threadPool;
+}
+
+QVector<MeshFileTool::MeshEntry> MeshFileTool::readMeshEntries(const QString &meshFile, LoadMode loadMode,
+                                                                QSharedPointer<MeshFileMapping> *mapping)
+{
+    QSharedPointer<MeshFileMapping> fileMapping;
+    if (loadMode == Mapped)
+        fileMapping = MeshFileMapping::map(meshFile);
+
+    MultiMeshInfo meshFileInfo;
+    if (fileMapping) {
+        QBuffer buffer;
+        buffer.setData(QByteArray::fromRawData(fileMapping->data(), fileMapping->size()));
+        buffer.open(QIODevice::ReadOnly);
+        meshFileInfo = readMultiMeshInfo(buffer);
+    } else {
+        // Not every file can be mapped (compressed resources for example)
+        QFile file(meshFile);
+        TraceSpan span("open file");
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "Failed to open file: " << meshFile;
+            return QVector<MeshEntry>();
+        }
+        span.end();
+        meshFileInfo = readMultiMeshInfo(file);
+        file.close();
+    }
+
+    if (!meshFileInfo.isValid())
+        return QVector<MeshEntry>();
+
+    QVector<MeshEntry> entries;
+    entries.reserve(meshFileInfo.meshEntires.count());
+    for (auto it = meshFileInfo.meshEntires.cbegin(); it != meshFileInfo.meshEntires.cend(); ++it)
+        entries.append({ it.key(), it.value() });
+    if (mapping)
+        *mapping = fileMapping;
+    return entries;
+}
+
+Mesh *MeshFileTool::loadMeshEntry(const QString &meshFile, const QSharedPointer<MeshFileMapping> &mapping,
+                                  const MeshEntry &entry, quint64 *bytesRead,
+                                  const Mesh::ProgressCallback &progressCallback)
+{
+    Mesh *mesh = new Mesh();
+    mesh->setMeshId(entry.id);
+    const quint64 result = mapping ? mesh->loadMesh(mapping, entry.offset, progressCallback)
+                                   : mesh->loadMesh(meshFile, entry.offset, progressCallback);
+    if (bytesRead)
+        *bytesRead = result;
+    if (result > 0)
+        return mesh;
+    delete mesh;
+    return nullptr;
+}
+
+QVector<Mesh *> MeshFileTool::loadMeshFile(const QString &meshFile, LoadMode loadMode,
+                                           const ProgressCallback &progressCallback)
+{
+    QSharedPointer<MeshFileMapping> mapping;
+    const QVector<MeshEntry> entries = readMeshEntries(meshFile, loadMode, &mapping);
+    if (entries.isEmpty())
+        return QVector<Mesh *>();
+    const qint64 fileSize = mapping ? mapping->size() : QFileInfo(meshFile).size();
+
+    // The footer has been parsed
+    const qint64 footerSize = 16 + 16 * qint64(entries.count());
+    std::atomic<qint64> bytesParsed = footerSize;
+    std::atomic<bool> canceled = progressCallback && !progressCallback(footerSize, fileSize);
+
+    // Load mesh for each entry, every entry is independent so they are
+    // parsed in parallel. blockingMapped keeps the results in the order of
+    // the entries, which is by id.
+    auto loadEntry = [&](const MeshEntry &entry) -> Mesh * {
+        if (canceled)
+            return nullptr;
+        // Entries report their own progress, added up for the whole file
+        qint64 entryBytesRead = 0;
+        Mesh::ProgressCallback entryProgress;
+        if (progressCallback) {
+            entryProgress = [&](qint64 bytesRead, qint64) {
+                const qint64 parsed = bytesParsed += bytesRead - entryBytesRead;
+                entryBytesRead = bytesRead;
+                if (!canceled && !progressCallback(parsed, fileSize))
+                    canceled = true;
+                return !canceled;
+            };
+        }
+        return loadMeshEntry(meshFile, mapping, entry, nullptr, entryProgress);
+    };
+    QThreadPool *pool = m_threadPool ? m_threadPool : QThreadPool::globalInstance();
+    const QList<Mesh *> results = QtConcurrent::blockingMapped<QList<Mesh *>>(pool, entries, loadEntry);
+
+    if (canceled) {
+        qDeleteAll(results);
+        return QVector<Mesh *>();
+    }
+
+    QVector<Mesh *> meshes;
+    for (auto mesh : results) {
+        if (mesh)
+            meshes.append(mesh);
+    }
+
+    return meshes;
+}
+
+QVector<MeshSummary> MeshFileTool::statMeshFile(const QString &meshFile)
 {
+    // Plain reads, only the tables are touched so there is nothing to gain from mapping
     QFile file(meshFile);
     if (!file.open(QIODevice::ReadOnly)) {
         qWarning() << "Failed to open file: " << meshFile;
-        return QVector<Mesh *>();
+        return QVector<MeshSummary>();
     }
 
+    MultiMeshInfo meshFileInfo = readMultiMeshInfo(file);
+    if (!meshFileInfo.isValid())
+        return QVector<MeshSummary>();
+
+    QVector<MeshSummary> summaries;
+    summaries.reserve(meshFileInfo.meshEntires.count());
+    for (auto it = meshFileInfo.meshEntires.cbegin(); it != meshFileInfo.meshEntires.cend(); ++it) {
+        MeshSummary summary;
+        summary.id = it.key();
+        summary.offset = it.value();
+        Mesh mesh;
+        if (mesh.readMesh(file, it.value(), &summary) > 0)
+            summaries.append(summary);
+    }
+
+    return summaries;
+}
+
+quint32 MeshSummary::indexCount() const
+{
+    if (indexComponentType == Mesh::UnsignedInt16)
+        return indexDataSize / sizeof(quint16);
+    if (indexComponentType == Mesh::UnsignedInt32)
+        return indexDataSize / sizeof(quint32);
+    return 0;
+}
+
+MeshFileTool::MultiMeshInfo MeshFileTool::readMultiMeshInfo(QIODevice &file)
+{
+    TraceSpan span("parse footer");
+    MultiMeshInfo meshFileInfo;
+    if (file.size() < 16)
+        return meshFileInfo;
+
     QDataStream inputStream(&file);
     inputStream.setByteOrder(QDataStream::LittleEndian);
     file.seek(file.size() - 16);
 
-    MultiMeshInfo meshFileInfo;
     inputStream >> meshFileInfo.fileId >> meshFileInfo.fileVersion;
     file.seek(file.pos() + 4);
     quint32 meshCount;
     inputStream >> meshCount;
 
+    if (!meshFileInfo.isValid())
+        return meshFileInfo;
+
     for (int i = 0; i < meshCount; ++i) {
         file.seek(-16 + (-16 * meshCount) + (16 * i) + file.size());
         quint64 offset;
@@ -236,294 +1034,253 @@ QVector<Mesh *> MeshFileTool::loadMeshFile(const QString &meshFile)
         inputStream >> offset >> id;
         meshFileInfo.meshEntires.insert(id, offset);
     }
-    file.close();
 
-    if (!meshFileInfo.isValid())
-        return QVector<Mesh *>();
+    return meshFileInfo;
+}
 
-    QVector<Mesh *> meshes;
+bool MeshFileTool::saveMeshFile(const QString &meshFile, const QVector<Mesh *> meshes)
+{
+    // Written to a temporary file first, so saving over the mapped file
+    // that the meshes were loaded from is safe
+    QSaveFile file(meshFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to open file: " << meshFile;
+        return false;
+    }
 
-    // Load mesh for each entry
-    for (auto key : meshFileInfo.meshEntires.keys()) {
-        Mesh *mesh = new Mesh();
-        quint64 result = mesh->loadMesh(meshFile, meshFileInfo.meshEntires[key]);
-        if (result > 0)
-            meshes.append(mesh);
-        else
-            delete mesh;
+    MultiMeshInfo meshFileInfo;
+    meshFileInfo.fileId = 555777497;
+    meshFileInfo.fileVersion = 1;
+    for (int i = 0; i < meshes.count(); ++i) {
+        const Mesh *mesh = meshes.at(i);
+        const quint64 offset = file.pos();
+        if (mesh->writeMesh(file) == 0) {
+            file.cancelWriting();
+            return false;
+        }
+        // Meshes created in memory have no id yet
+        quint32 id = mesh->meshId();
+        if (id == 0 || meshFileInfo.meshEntires.contains(id))
+            id = i + 1;
+        meshFileInfo.meshEntires.insert(id, offset);
     }
 
-    return meshes;
+    // Multi mesh footer
+    const qint64 footerOffset = file.pos();
+    QDataStream outputStream(&file);
+    outputStream.setByteOrder(QDataStream::LittleEndian);
+    for (auto it = meshFileInfo.meshEntires.cbegin(); it != meshFileInfo.meshEntires.cend(); ++it)
+        outputStream << it.value() << it.key() << quint32(0);
+    // Readers find the footer from the end of the file and the entry
+    // offsets are 64 bit, only this offset field is 32 bit. It is
+    // saturated for files past 4 GB.
+    const quint32 footerOffsetField = quint32(qMin(footerOffset, qint64(std::numeric_limits<quint32>::max())));
+    outputStream << meshFileInfo.fileId
+                 << meshFileInfo.fileVersion
+                 << footerOffsetField
+                 << quint32(meshFileInfo.meshEntires.count());
+
+    if (outputStream.status() != QDataStream::Ok) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
 }
 
-void MeshFileTool::saveMeshFile(const QString &meshFile, const QVector<Mesh *> meshes)
-{
-
-}
 
 Mesh::Subset::Subset(const Mesh &mesh, int subsetIndex)
+    : m_mesh(mesh)
 {
-    // Construct subset information
-    static const QByteArray c_positionAttributeName = "attr_pos";
-    static const QByteArray c_normalAttributeName = "attr_norm";
-    static const QByteArray c_uvAttributeName = "attr_uv"; // + number
-    static const QByteArray c_tangentAttributeName = "attr_textan";
-    static const QByteArray c_binormalAttributeName = "attr_binormal";
-    static const QByteArray c_colorAttributeName = "attr_color";
-    static const QByteArray c_jointAttributeName = "attr_joints";
-    static const QByteArray c_weightAttributeName = "attr_weights";
-    static const QByteArray c_morphTargetAttributeName = "attr_t"; // + number
+    static std::atomic<quint64> nextCacheKey = 1;
+    m_cacheKey = nextCacheKey++;
 
     const MeshSubset &subset = mesh.m_meshSubsets[subsetIndex];
     m_name = QString::fromUtf16(reinterpret_cast<const char16_t *>(subset.name.data()));
     m_count = subset.count; // not quite true
+    m_offset = subset.offset;
     m_bounds.min = subset.bounds.min;
     m_bounds.max = subset.bounds.max;
     m_drawMode = mesh.m_drawMode;
     m_windingMode = mesh.m_windingMode;
 
-    // Attributes
-    // Index (need full index table to do lookups)
-    QVector<quint32> indexes;
-    if (mesh.m_indexBuffer.componentType == ComponentType::UnsignedInt16) {
-        const quint16 *p = reinterpret_cast<const quint16 *>(mesh.m_indexBuffer.data.data());
-        const int length = mesh.m_indexBuffer.data.size() / sizeof(quint16);
-        indexes.resize(length);
-        for (int i = 0; i < length; ++i)
-            indexes[i] = quint32(p[i]);
-    } else if (mesh.m_indexBuffer.componentType == ComponentType::UnsignedInt32) {
-        const quint32 *p = reinterpret_cast<const quint32 *>(mesh.m_indexBuffer.data.data());
-        const int length = mesh.m_indexBuffer.data.size() / sizeof(quint32);
-        indexes.resize(length);
-        for (int i = 0; i < length; ++i)
-            indexes[i] = p[i];
+    if (quint64(m_offset) + m_count > mesh.indexCount()) {
+        qWarning() << "Subset" << subsetIndex << "references indexes past the end of the index buffer";
+        m_offset = qMin(m_offset, mesh.indexCount());
+        m_count = mesh.indexCount() - m_offset;
     }
 
-    const quint32 stride = mesh.m_vertexBuffer.stride;
-
-    const quint32 count = subset.count;
-    const quint32 offset = subset.offset;
-
-    // Position
-    int positionOffset = -1;
-    for (const auto &entry : mesh.m_vertexBuffer.entires) {
-        if (entry.name.contains(c_positionAttributeName)) {
-            positionOffset = entry.firstItemOffset;
-            break;
-        }
-    }
-    if (positionOffset > -1) {
-        m_positions.resize(count);
-        for (int i = 0; i < count; ++i) {
-            const quint32 localByteOffset = stride * indexes[i + offset] + positionOffset;
-            const QVector3D *p = reinterpret_cast<const QVector3D *>(mesh.m_vertexBuffer.data.data() + localByteOffset);
-            m_positions[i] = *p;
-        }
-    }
-
-    // Normal
-    int normalOffset = -1;
-    for (const auto &entry : mesh.m_vertexBuffer.entires) {
-        if (entry.name.contains(c_normalAttributeName)) {
-            normalOffset = entry.firstItemOffset;
-            break;
-        }
-    }
-    if (normalOffset > -1) {
-        m_normals.resize(count);
-        for (int i = 0; i < count; ++i) {
-            const quint32 localByteOffset = stride * indexes[i + offset] + normalOffset;
-            const QVector3D *p = reinterpret_cast<const QVector3D *>(mesh.m_vertexBuffer.data.data() + localByteOffset);
-            m_normals[i] = *p;
-        }
-    }
-
-    // UV(s)
-    QMap<int, int> uvOffsetMap;
-    for (const auto &entry : mesh.m_vertexBuffer.entires) {
-        if (entry.name.contains(c_uvAttributeName)) {
-            // Need to break down the name to get the UV channel
-            QString attributeName = QString::fromLocal8Bit(entry.name);
-            QString uvIndexString = attributeName.remove(c_uvAttributeName);
-            int uvIndex = uvIndexString.toInt();
-            uvOffsetMap.insert(uvIndex, entry.firstItemOffset);
-        }
-    }
-    for (int uvIndex : uvOffsetMap.keys()) {
-        QVector<QVector2D> uvData;
-        uvData.resize(count);
-        for (int i = 0; i < count; ++i) {
-            const quint32 localByteOffset = stride * indexes[i + offset] + uvOffsetMap[uvIndex];
-            const QVector2D *p = reinterpret_cast<const QVector2D *>(mesh.m_vertexBuffer.data.data() + localByteOffset);
-            uvData[i] = *p;
-        }
-        m_uvs.insert(uvIndex, uvData);
-    }
-
-    // Tangents
-    int tangentOffset = -1;
-    for (const auto &entry : mesh.m_vertexBuffer.entires) {
-        if (entry.name.contains(c_tangentAttributeName)) {
-            tangentOffset = entry.firstItemOffset;
-            break;
-        }
-    }
-    if (tangentOffset > -1) {
-        m_tangents.resize(count);
-        for (int i = 0; i < count; ++i) {
-            const quint32 localByteOffset = stride * indexes[i + offset] + tangentOffset;
-            const QVector3D *p = reinterpret_cast<const QVector3D *>(mesh.m_vertexBuffer.data.data() + localByteOffset);
-            m_tangents[i] = *p;
-        }
-    }
+    // Attributes are decoded on first access, see decodeAttribute()
+}
 
-    // Binormals
-    int binormalsOffset = -1;
-    for (const auto &entry : mesh.m_vertexBuffer.entires) {
-        if (entry.name.contains(c_binormalAttributeName)) {
-            binormalsOffset = entry.firstItemOffset;
-            break;
-        }
-    }
-    if (binormalsOffset > -1) {
-        m_binormals.resize(count);
-        for (int i = 0; i < count; ++i) {
-            const quint32 localByteOffset = stride * indexes[i + offset] + binormalsOffset;
-            const QVector3D *p = reinterpret_cast<const QVector3D *>(mesh.m_vertexBuffer.data.data() + localByteOffset);
-            m_binormals[i] = *p;
-        }
-    }
+Mesh::Subset::Subset(const Mesh &mesh, const Subset &other)
+    : m_mesh(mesh)
+    , m_name(other.m_name)
+    , m_bounds(other.m_bounds)
+    , m_windingMode(other.m_windingMode)
+    , m_drawMode(other.m_drawMode)
+    , m_count(other.m_count)
+    , m_offset(other.m_offset)
+    , m_cacheKey(other.m_cacheKey)
+{
+    reuseDecodedData(other);
+}
 
-    // Colors
-    int colorsOffset = -1;
-    for (const auto &entry : mesh.m_vertexBuffer.entires) {
-        if (entry.name.contains(c_colorAttributeName)) {
-            colorsOffset = entry.firstItemOffset;
-            break;
-        }
-    }
-    if (colorsOffset > -1) {
-        m_colors.resize(count);
-        for (int i = 0; i < count; ++i) {
-            const quint32 localByteOffset = stride * indexes[i + offset] + colorsOffset;
-            const QVector4D *p = reinterpret_cast<const QVector4D *>(mesh.m_vertexBuffer.data.data() + localByteOffset);
-            m_colors[i] = *p;
-        }
+QByteArray Mesh::Subset::contentHash() const
+{
+    if (!m_contentHash.isEmpty() || m_mesh.isDetached())
+        return m_contentHash;
+
+    TraceSpan span("hash subset");
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(m_mesh.m_layoutHash);
+    addHashValue(hash, m_count);
+    addHashValue(hash, m_bounds.min);
+    addHashValue(hash, m_bounds.max);
+    if (m_count > 0) {
+        const IndexBuffer &indexBuffer = m_mesh.m_indexBuffer;
+        const quint64 indexSize = indexBuffer.componentType == ComponentType::UnsignedInt16 ? 2 : 4;
+        hash.addData(QByteArrayView(indexBuffer.data.constData() + m_offset * indexSize, m_count * indexSize));
+
+        // Only the vertexes between the smallest and largest index, so
+        // editing a vertex does not change the subsets that do not use it
+        const quint32 *indexes = m_mesh.indexData() + m_offset;
+        const auto range = std::minmax_element(indexes, indexes + m_count);
+        const VertexBuffer &vertexBuffer = m_mesh.m_vertexBuffer;
+        const quint64 vertexBufferSize = vertexBuffer.data.size();
+        const quint64 begin = qMin(quint64(*range.first) * vertexBuffer.stride, vertexBufferSize);
+        const quint64 end = qMin((quint64(*range.second) + 1) * vertexBuffer.stride, vertexBufferSize);
+        hash.addData(QByteArrayView(vertexBuffer.data.constData() + begin, end - begin));
     }
+    const QByteArray result = hash.result();
+    // Hashed partly from a file that was changing
+    if (m_mesh.isDetached())
+        return QByteArray();
+    m_contentHash = result;
+    return m_contentHash;
+}
 
-    // Joints
-    int jointsOffset = -1;
-    for (const auto &entry : mesh.m_vertexBuffer.entires) {
-        if (entry.name.contains(c_jointAttributeName)) {
-            jointsOffset = entry.firstItemOffset;
-            break;
-        }
-    }
-    if (jointsOffset > -1) {
-        m_joints.resize(count);
-        for (int i = 0; i < count; ++i) {
-            const quint32 localByteOffset = stride * indexes[i + offset] + jointsOffset;
-            const QVector4D *p = reinterpret_cast<const QVector4D *>(mesh.m_vertexBuffer.data.data() + localByteOffset);
-            m_joints[i] = *p;
-        }
-    }
+void Mesh::Subset::reuseDecodedData(const Subset &unchanged)
+{
+    if (unchanged.m_decodedAfterDetach)
+        return;
+    m_cacheKey = unchanged.m_cacheKey;
+    m_diskCacheChecked = m_diskCacheChecked || unchanged.m_diskCacheChecked;
+    if (m_contentHash.isEmpty())
+        m_contentHash = unchanged.m_contentHash;
+
+    // What this subset decoded meanwhile is kept
+    const quint32 taken = unchanged.m_decodedAttributes & ~m_decodedAttributes;
+    auto take = [taken](quint32 attribute, auto &to, const auto &from) {
+        if (taken & attribute)
+            to = from;
+    };
+    take(PositionsDecoded, m_positions, unchanged.m_positions);
+    take(NormalsDecoded, m_normals, unchanged.m_normals);
+    take(UVsDecoded, m_uvs, unchanged.m_uvs);
+    take(TangentsDecoded, m_tangents, unchanged.m_tangents);
+    take(BinormalsDecoded, m_binormals, unchanged.m_binormals);
+    take(ColorsDecoded, m_colors, unchanged.m_colors);
+    take(JointsDecoded, m_joints, unchanged.m_joints);
+    take(WeightsDecoded, m_weights, unchanged.m_weights);
+    take(MorphTargetPositionsDecoded, m_morphTargetPositions, unchanged.m_morphTargetPositions);
+    take(MorphTargetNormalsDecoded, m_morphTargetNormals, unchanged.m_morphTargetNormals);
+    take(MorphTargetTangentsDecoded, m_morphTargetTangents, unchanged.m_morphTargetTangents);
+    take(MorphTargetBinormalsDecoded, m_morphTargetBinormals, unchanged.m_morphTargetBinormals);
+    m_decodedAttributes |= taken;
+}
 
-    // Weights
-    int weightsOffset = -1;
-    for (const auto &entry : mesh.m_vertexBuffer.entires) {
-        if (entry.name.contains(c_weightAttributeName)) {
-            weightsOffset = entry.firstItemOffset;
-            break;
-        }
-    }
-    if (weightsOffset > -1) {
-        m_weights.resize(count);
-        for (int i = 0; i < count; ++i) {
-            const quint32 localByteOffset = stride * indexes[i + offset] + weightsOffset;
-            const QVector4D *p = reinterpret_cast<const QVector4D *>(mesh.m_vertexBuffer.data.data() + localByteOffset);
-            m_weights[i] = *p;
-        }
-    }
+Mesh *Mesh::Subset::sharedCopy() const
+{
+    // Everything the decoding and hashing read, the buffers are implicitly
+    // shared and the mapping stays open as long as the copy holds it
+    auto mesh = new Mesh;
+    mesh->m_meshInfo = m_mesh.m_meshInfo;
+    mesh->m_sectionOffsets = m_mesh.m_sectionOffsets;
+    mesh->m_meshId = m_mesh.m_meshId;
+    mesh->m_fileOffset = m_mesh.m_fileOffset;
+    mesh->m_vertexBuffer = m_mesh.m_vertexBuffer;
+    mesh->m_indexBuffer = m_mesh.m_indexBuffer;
+    mesh->m_meshSubsets = m_mesh.m_meshSubsets;
+    mesh->m_joints = m_mesh.m_joints;
+    mesh->m_widenedIndexes = m_mesh.m_widenedIndexes;
+    mesh->m_drawMode = m_mesh.m_drawMode;
+    mesh->m_windingMode = m_mesh.m_windingMode;
+    mesh->m_vertexLayout = m_mesh.m_vertexLayout;
+    mesh->m_layoutHash = m_mesh.m_layoutHash;
+    mesh->m_mapping = m_mesh.m_mapping;
+    mesh->m_subsets.append(new Subset(*mesh, *this));
+    return mesh;
+}
 
-    // Morph Target(s)
-    QMap<int, int> morphTargetPositionOffsetMap;
-    QMap<int, int> morphTargetNormalOffsetMap;
-    QMap<int, int> morphTargetTangentOffsetMap;
-    QMap<int, int> morphTargetBinormalOffsetMap;
-    for (const auto &entry : mesh.m_vertexBuffer.entires) {
-        if (entry.name.contains(c_morphTargetAttributeName)) {
-            // Need to break down the name to get the UV channel
-            QString attributeName = QString::fromLocal8Bit(entry.name);
-            // Handle special case
-            if (attributeName == QStringLiteral("attr_textan"))
-                continue;
-            QString morphTargetString = attributeName.remove(c_morphTargetAttributeName);
-            if (morphTargetString.contains("pos")) {
-                int morphTargetPositionIndex = morphTargetString.remove("pos").toInt();
-                morphTargetPositionOffsetMap.insert(morphTargetPositionIndex, entry.firstItemOffset);
-            } else if (morphTargetString.contains("norm")) {
-                int morphTargetNormalIndex = morphTargetString.remove("norm").toInt();
-                morphTargetNormalOffsetMap.insert(morphTargetNormalIndex, entry.firstItemOffset);
-            } else if (morphTargetString.contains("tan")) {
-                int morphTargetTangentIndex = morphTargetString.remove("tan").toInt();
-                morphTargetTangentOffsetMap.insert(morphTargetTangentIndex, entry.firstItemOffset);
-            } else if (morphTargetString.contains("binorm")) {
-                int morphTargetBinormalIndex = morphTargetString.remove("binorm").toInt();
-                morphTargetBinormalOffsetMap.insert(morphTargetBinormalIndex, entry.firstItemOffset);
-            }
-        }
-    }
-    // Morph Target Position
-    for (int positionIndex : morphTargetPositionOffsetMap.keys()) {
-        QVector<QVector3D> posData;
-        posData.resize(count);
-        for (int i = 0; i < count; ++i) {
-            const quint32 localByteOffset = stride * indexes[i + offset] + morphTargetPositionOffsetMap[positionIndex];
-            const QVector3D *p = reinterpret_cast<const QVector3D *>(mesh.m_vertexBuffer.data.data() + localByteOffset);
-            posData[i] = *p;
+bool Mesh::Subset::isDecoded(DecodedAttribute attribute) const
+{
+    if (!(m_decodedAttributes & attribute) && !m_diskCacheChecked) {
+        m_diskCacheChecked = true;
+        // Taken while the pages are read anyway, so a reload can still
+        // match the decoded attributes after the file changed
+        contentHash();
+        if (DiskCache::isEnabled()) {
+            const DiskCache::Record record = DiskCache::load(DiskCache::subsetKey(this));
+            if (record.isValid())
+                DiskCache::restoreSubset(record, this);
         }
-        m_morphTargetPositions.insert(positionIndex, posData);
     }
+    return m_decodedAttributes & attribute;
+}
 
-    // Morph Target Normal
-    for (int normalIndex : morphTargetNormalOffsetMap.keys()) {
-        QVector<QVector3D> normalData;
-        normalData.resize(count);
-        for (int i = 0; i < count; ++i) {
-            const quint32 localByteOffset = stride * indexes[i + offset] + morphTargetNormalOffsetMap[normalIndex];
-            const QVector3D *p = reinterpret_cast<const QVector3D *>(mesh.m_vertexBuffer.data.data() + localByteOffset);
-            normalData[i] = *p;
-        }
-        m_morphTargetNormals.insert(normalIndex, normalData);
+template <typename T>
+QVector<T> Mesh::Subset::decodeAttribute(const VertexAttribute *attribute) const
+{
+    QVector<T> data;
+    if (!attribute)
+        return data;
+    // The file changed, the mesh is about to be replaced by a reload
+    if (m_mesh.isDetached()) {
+        m_decodedAfterDetach = true;
+        return data;
     }
-
-    // Morph Target Tangent
-    for (int tangentIndex : morphTargetTangentOffsetMap.keys()) {
-        QVector<QVector3D> tangentData;
-        tangentData.resize(count);
-        for (int i = 0; i < count; ++i) {
-            const quint32 localByteOffset = stride * indexes[i + offset] + morphTargetTangentOffsetMap[tangentIndex];
-            const QVector3D *p = reinterpret_cast<const QVector3D *>(mesh.m_vertexBuffer.data.data() + localByteOffset);
-            tangentData[i] = *p;
-        }
-        m_morphTargetTangents.insert(tangentIndex, tangentData);
+    TraceSpan span(decodeSpanName(attribute->semantic));
+
+    AttributeDecoder::Source source;
+    source.data = m_mesh.m_vertexBuffer.data.constData();
+    source.size = m_mesh.m_vertexBuffer.data.size();
+    source.stride = m_mesh.m_vertexBuffer.stride;
+    source.offset = attribute->offset;
+    source.componentType = attribute->componentType;
+    source.numComponents = attribute->numComponents;
+    source.normalized = isNormalizedSemantic(attribute->semantic);
+
+    data.resize(m_count);
+    // Only this subset's range of the shared index table is touched
+    const quint32 *indexes = m_mesh.indexData() + m_offset;
+    float *out = reinterpret_cast<float *>(data.data());
+    if (!AttributeDecoder::decode(source, indexes, m_count, out, sizeof(T) / sizeof(float))) {
+        qWarning() << "Unsupported vertex attribute format" << attribute->componentType
+                   << "with" << attribute->numComponents << "components";
+        data.clear();
     }
+    if (m_mesh.isDetached())
+        m_decodedAfterDetach = true;
+    return data;
+}
 
-    // Morph Target Tangent
-    for (int binormalIndex : morphTargetBinormalOffsetMap.keys()) {
-        QVector<QVector3D> binormalData;
-        binormalData.resize(count);
-        for (int i = 0; i < count; ++i) {
-            const quint32 localByteOffset = stride * indexes[i + offset] + morphTargetBinormalOffsetMap[binormalIndex];
-            const QVector3D *p = reinterpret_cast<const QVector3D *>(mesh.m_vertexBuffer.data.data() + localByteOffset);
-            binormalData[i] = *p;
-        }
-        m_morphTargetBinormals.insert(binormalIndex, binormalData);
+template <typename T>
+QMap<int, QVector<T>> Mesh::Subset::decodeChannels(AttributeSemantic semantic) const
+{
+    QMap<int, QVector<T>> channels;
+    for (const auto &attribute : m_mesh.m_vertexLayout) {
+        if (attribute.semantic == semantic)
+            channels.insert(attribute.channel, decodeAttribute<T>(&attribute));
     }
+    return channels;
 }
 
 QMap<int, QVector<QVector3D> > Mesh::Subset::morphTargetBinormals() const
 {
+    if (!isDecoded(MorphTargetBinormalsDecoded)) {
+        m_decodedAttributes |= MorphTargetBinormalsDecoded;
+        m_morphTargetBinormals = decodeChannels<QVector3D>(MorphTargetBinormalSemantic);
+    }
     return m_morphTargetBinormals;
 }
 
@@ -537,6 +1294,23 @@ int Mesh::Subset::count() const
     return m_count;
 }
 
+qint64 Mesh::Subset::decodedBytes() const
+{
+    auto bytes = [](const auto &values) {
+        return qint64(values.size()) * qint64(sizeof(typename std::decay_t<decltype(values)>::value_type));
+    };
+    auto channelBytes = [&bytes](const auto &channels) {
+        qint64 total = 0;
+        for (const auto &values : channels)
+            total += bytes(values);
+        return total;
+    };
+    return bytes(m_positions) + bytes(m_normals) + channelBytes(m_uvs) + bytes(m_tangents)
+            + bytes(m_binormals) + bytes(m_colors) + bytes(m_joints) + bytes(m_weights)
+            + channelBytes(m_morphTargetPositions) + channelBytes(m_morphTargetNormals)
+            + channelBytes(m_morphTargetTangents) + channelBytes(m_morphTargetBinormals);
+}
+
 Mesh::WindingMode Mesh::Subset::windingMode() const
 {
     return m_windingMode;
@@ -554,55 +1328,104 @@ QString Mesh::Subset::name() const
 
 QMap<int, QVector<QVector3D> > Mesh::Subset::morphTargetTangents() const
 {
+    if (!isDecoded(MorphTargetTangentsDecoded)) {
+        m_decodedAttributes |= MorphTargetTangentsDecoded;
+        m_morphTargetTangents = decodeChannels<QVector3D>(MorphTargetTangentSemantic);
+    }
     return m_morphTargetTangents;
 }
 
 QMap<int, QVector<QVector3D> > Mesh::Subset::morphTargetNormals() const
 {
+    if (!isDecoded(MorphTargetNormalsDecoded)) {
+        m_decodedAttributes |= MorphTargetNormalsDecoded;
+        m_morphTargetNormals = decodeChannels<QVector3D>(MorphTargetNormalSemantic);
+    }
     return m_morphTargetNormals;
 }
 
 QMap<int, QVector<QVector3D> > Mesh::Subset::morphTargetPositions() const
 {
+    if (!isDecoded(MorphTargetPositionsDecoded)) {
+        m_decodedAttributes |= MorphTargetPositionsDecoded;
+        m_morphTargetPositions = decodeChannels<QVector3D>(MorphTargetPositionSemantic);
+    }
     return m_morphTargetPositions;
 }
 
 QVector<QVector4D> Mesh::Subset::weights() const
 {
+    if (!isDecoded(WeightsDecoded)) {
+        m_decodedAttributes |= WeightsDecoded;
+        m_weights = decodeAttribute<QVector4D>(m_mesh.findAttribute(WeightSemantic));
+    }
     return m_weights;
 }
 
 QVector<QVector4D> Mesh::Subset::joints() const
 {
+    if (!isDecoded(JointsDecoded)) {
+        m_decodedAttributes |= JointsDecoded;
+        m_joints = decodeAttribute<QVector4D>(m_mesh.findAttribute(JointSemantic));
+    }
     return m_joints;
 }
 
 QVector<QVector4D> Mesh::Subset::colors() const
 {
+    if (!isDecoded(ColorsDecoded)) {
+        m_decodedAttributes |= ColorsDecoded;
+        m_colors = decodeAttribute<QVector4D>(m_mesh.findAttribute(ColorSemantic));
+    }
     return m_colors;
 }
 
 QVector<QVector3D> Mesh::Subset::binormals() const
 {
+    if (!isDecoded(BinormalsDecoded)) {
+        m_decodedAttributes |= BinormalsDecoded;
+        m_binormals = decodeAttribute<QVector3D>(m_mesh.findAttribute(BinormalSemantic));
+    }
     return m_binormals;
 }
 
 QVector<QVector3D> Mesh::Subset::tangents() const
 {
+    if (!isDecoded(TangentsDecoded)) {
+        m_decodedAttributes |= TangentsDecoded;
+        m_tangents = decodeAttribute<QVector3D>(m_mesh.findAttribute(TangentSemantic));
+    }
     return m_tangents;
 }
 
 QMap<int, QVector<QVector2D> > Mesh::Subset::uvs() const
 {
+    if (!isDecoded(UVsDecoded)) {
+        m_decodedAttributes |= UVsDecoded;
+        m_uvs = decodeChannels<QVector2D>(TexCoordSemantic);
+    }
     return m_uvs;
 }
 
 QVector<QVector3D> Mesh::Subset::normals() const
 {
+    if (!isDecoded(NormalsDecoded)) {
+        m_decodedAttributes |= NormalsDecoded;
+        m_normals = decodeAttribute<QVector3D>(m_mesh.findAttribute(NormalSemantic));
+    }
     return m_normals;
 }
 
+bool Mesh::Subset::hasAttribute(AttributeSemantic semantic) const
+{
+    return m_mesh.findAttribute(semantic) != nullptr;
+}
+
 QVector<QVector3D> Mesh::Subset::positions() const
 {
+    if (!isDecoded(PositionsDecoded)) {
+        m_decodedAttributes |= PositionsDecoded;
+        m_positions = decodeAttribute<QVector3D>(m_mesh.findAttribute(PositionSemantic));
+    }
     return m_positions;
 }
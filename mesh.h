@@ -31,27 +31,45 @@
 #include <QVector3D>
 #include <QVector>
 #include <QMap>
+#include <QFile>
+#include <QSharedPointer>
+#include <QStringList>
+
+#include <atomic>
+#include <functional>
+
+class QIODevice;
+class QThreadPool;
+class MeshFileTool;
+class DiskCache;
+struct MeshSummary;
+
+// Keeps a .mesh file mapped into memory for as long as any Mesh
+// still refers to its vertex or index data.
+class MeshFileMapping
+{
+public:
+    ~MeshFileMapping();
 
-class Mesh;
+    static QSharedPointer<MeshFileMapping> map(const QString &meshFile);
 
-class MeshFileTool {
-public:
-    MeshFileTool();
+    const char *data() const { return reinterpret_cast<const char *>(m_data); }
+    qint64 size() const { return m_size; }
 
-    QVector<Mesh *> loadMeshFile(const QString &meshFile);
-    void saveMeshFile(const QString &meshFile, const QVector<Mesh *> meshes);
+    // Called when the file changes on disk. Meshes stop decoding and
+    // hashing through the mapping, and where the OS allows it the pages are
+    // replaced by zeros so reads still in flight cannot fault on a
+    // truncated file.
+    void detach();
+    bool isDetached() const { return m_detached; }
 
 private:
-    struct MultiMeshInfo
-    {
-        quint32 fileId = 0;
-        quint32 fileVersion = 0;
-        QMap<quint32, quint64> meshEntires;
+    MeshFileMapping(const QString &meshFile);
 
-        bool isValid() {
-            return fileId == 555777497 && fileVersion == 1;
-        }
-    };
+    QFile m_file;
+    uchar *m_data = nullptr;
+    qint64 m_size = 0;
+    std::atomic<bool> m_detached = false;
 };
 
 class Mesh
@@ -79,6 +97,45 @@ public:
         CounterClockwise
     };
 
+    enum ComponentType {
+        UnsignedInt8 = 1,
+        Int8,
+        UnsignedInt16,
+        Int16,
+        UnsignedInt32,
+        Int32,
+        UnsignedInt64,
+        Int64,
+        Float16,
+        Float32,
+        Float64
+    };
+
+    enum AttributeSemantic {
+        UnknownSemantic,
+        PositionSemantic,
+        NormalSemantic,
+        TexCoordSemantic,
+        TangentSemantic,
+        BinormalSemantic,
+        ColorSemantic,
+        JointSemantic,
+        WeightSemantic,
+        MorphTargetPositionSemantic,
+        MorphTargetNormalSemantic,
+        MorphTargetTangentSemantic,
+        MorphTargetBinormalSemantic
+    };
+
+    // One entry of the vertex layout, parsed once from the attribute names
+    struct VertexAttribute {
+        AttributeSemantic semantic = UnknownSemantic;
+        int channel = 0; // UV channel or morph target index
+        ComponentType componentType = ComponentType::Float32;
+        quint32 numComponents = 0;
+        quint32 offset = 0;
+    };
+
     class Subset {
     public:
         Subset(const Mesh &mesh, int subsetIndex);
@@ -96,42 +153,147 @@ public:
         QMap<int, QVector<QVector3D> > morphTargetTangents() const;
         QMap<int, QVector<QVector3D> > morphTargetBinormals() const;
 
+        // Whether the vertex layout has the attribute, without decoding it
+        bool hasAttribute(AttributeSemantic semantic) const;
+
         QString name() const;
         MeshSubsetBounds bounds() const;
         WindingMode windingMode() const;
         DrawMode drawMode() const;
         int count() const;
 
+        // Bytes of the attributes decoded so far
+        qint64 decodedBytes() const;
+
+        // Unique for the lifetime of the application, unlike the address
+        quint64 cacheKey() const { return m_cacheKey; }
+
+        // Hash of the index range the attributes are decoded from and of the
+        // vertexes between its smallest and largest index, taken on first use
+        // and on first decode. Empty when the mapped file changed before.
+        QByteArray contentHash() const;
+        // Takes over the decoded attributes this subset does not have yet, the
+        // hash and the cache key of a subset with the same content, so a
+        // reloaded file does not decode it again. Nothing is taken when
+        // unchanged decoded anything after its file changed.
+        void reuseDecodedData(const Subset &unchanged);
+        // A mesh holding only a copy of this subset, which shares the buffers,
+        // file mapping and decoded attributes but not this mesh. It can be
+        // decoded on a worker while this mesh is deleted, and what it decoded
+        // handed back with reuseDecodedData().
+        Mesh *sharedCopy() const;
+
     private:
+        friend class Mesh;
+        friend class DiskCache;
+
+        Subset(const Mesh &mesh, const Subset &other);
+
+        enum DecodedAttribute {
+            PositionsDecoded = 0x1,
+            NormalsDecoded = 0x2,
+            UVsDecoded = 0x4,
+            TangentsDecoded = 0x8,
+            BinormalsDecoded = 0x10,
+            ColorsDecoded = 0x20,
+            JointsDecoded = 0x40,
+            WeightsDecoded = 0x80,
+            MorphTargetPositionsDecoded = 0x100,
+            MorphTargetNormalsDecoded = 0x200,
+            MorphTargetTangentsDecoded = 0x400,
+            MorphTargetBinormalsDecoded = 0x800
+        };
+
+        // Restores the attributes from the disk cache on first use
+        bool isDecoded(DecodedAttribute attribute) const;
+        template <typename T>
+        QVector<T> decodeAttribute(const VertexAttribute *attribute) const;
+        template <typename T>
+        QMap<int, QVector<T>> decodeChannels(AttributeSemantic semantic) const;
+
+        const Mesh &m_mesh;
         QString m_name;
         MeshSubsetBounds m_bounds;
         WindingMode m_windingMode;
         DrawMode m_drawMode;
         int m_count;
-        // Attributes
-        QVector<QVector3D> m_positions;
-        QVector<QVector3D> m_normals;
-        QMap<int, QVector<QVector2D>> m_uvs;
-        QVector<QVector3D> m_tangents;
-        QVector<QVector3D> m_binormals;
-        QVector<QVector4D> m_colors;
-        QVector<QVector4D> m_joints;
-        QVector<QVector4D> m_weights;
-        QMap<int, QVector<QVector3D>> m_morphTargetPositions;
-        QMap<int, QVector<QVector3D>> m_morphTargetNormals;
-        QMap<int, QVector<QVector3D>> m_morphTargetTangents;
-        QMap<int, QVector<QVector3D>> m_morphTargetBinormals;
+        quint32 m_offset;
+        quint64 m_cacheKey;
+        // Attributes, decoded from the mesh vertex buffer on first access
+        mutable quint32 m_decodedAttributes = 0;
+        mutable bool m_diskCacheChecked = false;
+        mutable bool m_decodedAfterDetach = false;
+        mutable QByteArray m_contentHash;
+        mutable QVector<QVector3D> m_positions;
+        mutable QVector<QVector3D> m_normals;
+        mutable QMap<int, QVector<QVector2D>> m_uvs;
+        mutable QVector<QVector3D> m_tangents;
+        mutable QVector<QVector3D> m_binormals;
+        mutable QVector<QVector4D> m_colors;
+        mutable QVector<QVector4D> m_joints;
+        mutable QVector<QVector4D> m_weights;
+        mutable QMap<int, QVector<QVector3D>> m_morphTargetPositions;
+        mutable QMap<int, QVector<QVector3D>> m_morphTargetNormals;
+        mutable QMap<int, QVector<QVector3D>> m_morphTargetTangents;
+        mutable QMap<int, QVector<QVector3D>> m_morphTargetBinormals;
     };
 
+    // Called while a mesh is read with the bytes read so far and the size
+    // of the mesh, returning false cancels reading it
+    using ProgressCallback = std::function<bool(qint64 bytesRead, qint64 bytesTotal)>;
+
     Mesh();
     ~Mesh();
 
     QVector<Subset *> subsets() const { return m_subsets; }
-
-    quint64 loadMesh(const QString &meshFile, quint64 offset);
+    // Size of a vertex and number of vertexes in the vertex buffer
+    quint32 vertexStride() const { return m_vertexBuffer.stride; }
+    quint32 vertexCount() const { return m_vertexBuffer.stride ? m_vertexBuffer.data.size() / m_vertexBuffer.stride : 0; }
+    QVector<VertexAttribute> vertexLayout() const { return m_vertexLayout; }
+    const VertexAttribute *findAttribute(AttributeSemantic semantic, int channel = 0) const;
+
+    quint64 loadMesh(const QString &meshFile, quint64 offset,
+                     const ProgressCallback &progressCallback = ProgressCallback());
+    quint64 loadMesh(const QSharedPointer<MeshFileMapping> &mapping, quint64 offset,
+                     const ProgressCallback &progressCallback = ProgressCallback());
     quint64 saveMesh(const QString &meshFile, quint64 offset);
 
+    // Memory held by the mesh. Data sections that reference a mapped file
+    // are counted as mapped, the OS pages those in and out as needed.
+    qint64 rawBufferBytes() const;
+    qint64 mappedBytes() const;
+    qint64 decodedBytes() const;
+
+    // Hash of everything the decoded attributes depend on, combined from
+    // the subset hashes. Empty when one of those was not taken before the
+    // mapped file changed.
+    QByteArray contentHash() const;
+    // The mapped file changed on disk, see MeshFileMapping::detach()
+    bool isDetached() const { return m_mapping && m_mapping->isDetached(); }
+
+    // Consistency checks of the loaded data, returns a description of every problem found
+    QStringList validate() const;
+    // Whether writing the mesh back reproduces the bytes it was mapped from,
+    // compared while it is written. False when it is not mapped.
+    bool roundTrips() const;
+
+    // Id of the mesh in the multi mesh footer
+    quint32 meshId() const { return m_meshId; }
+    void setMeshId(quint32 meshId) { m_meshId = meshId; }
+
 private:
+    friend class MeshFileTool;
+    friend class SyntheticMesh;
+    quint64 writeMesh(QIODevice &device) const;
+    quint64 readMesh(QIODevice &device, quint64 offset, MeshSummary *summary = nullptr,
+                     const ProgressCallback &progressCallback = ProgressCallback());
+    void buildVertexLayout();
+    void createSubsets();
+    const quint32 *indexData() const;
+    quint32 indexCount() const;
+    QByteArray readSection(QIODevice &device, quint32 size,
+                           const std::function<bool(qint64 bytesRead)> &progress = {});
+
     struct MeshDataHeader
     {
         quint32 fileId = 0;
@@ -146,12 +308,12 @@ private:
 
     struct MeshOffsetTracker
     {
-        quint32 startOffset = 0;
+        quint64 startOffset = 0;
         quint32 byteCounter = 0;
-        MeshOffsetTracker(int offset)
+        MeshOffsetTracker(quint64 offset)
             : startOffset(offset) {}
 
-        int offset() {
+        quint64 offset() {
             return startOffset + byteCounter;
         }
 
@@ -166,24 +328,11 @@ private:
         }
     };
 
-    enum ComponentType {
-        UnsignedInt8 = 1,
-        Int8,
-        UnsignedInt16,
-        Int16,
-        UnsignedInt32,
-        Int32,
-        UnsignedInt64,
-        Int64,
-        Float16,
-        Float32,
-        Float64
-    };
-
     struct VertexBufferEntry {
         ComponentType componentType = ComponentType::Float32;
         quint32 numComponents = 0;
         quint32 firstItemOffset = 0;
+        quint32 nameOffset = 0; // not used for loading, kept for saving
         QByteArray name;
     };
 
@@ -207,6 +356,7 @@ private:
         quint32 offset = 0;
         MeshSubsetBounds bounds;
         QByteArray name;
+        quint32 nameOffset = 0; // not used for loading, kept for saving
         quint32 nameLength = 0;
     };
 
@@ -217,16 +367,123 @@ private:
         QMatrix4x4 localToGlobalBoneSpace;
     };
 
+    // Offsets stored in the mesh structure, kept as read so files round trip
+    struct SectionOffsets {
+        quint32 vertexBufferEntries = 0;
+        quint32 vertexBufferData = 0;
+        quint32 indexBuffer = 0;
+        quint32 subsets = 0;
+        quint32 joints = 0;
+    };
+
     MeshDataHeader m_meshInfo;
+    SectionOffsets m_sectionOffsets;
+    quint32 m_meshId = 0;
+    quint64 m_fileOffset = 0;
     VertexBuffer m_vertexBuffer;
     IndexBuffer m_indexBuffer;
     QVector<MeshSubset> m_meshSubsets;
     QVector<Joint> m_joints;
+    // Only used when the index buffer holds 16bit indexes
+    QVector<quint32> m_widenedIndexes;
     DrawMode m_drawMode;
     WindingMode m_windingMode;
 
+    QVector<VertexAttribute> m_vertexLayout;
+    // Hash of the vertex layout and index type, the start of every subset hash
+    QByteArray m_layoutHash;
+    mutable QByteArray m_contentHash;
+
+    // Set when the buffers above point into a mapped file
+    QSharedPointer<MeshFileMapping> m_mapping;
+
     // Easy to consume info:
     QVector<Subset *> m_subsets;
 };
 
+// Lightweight description of one mesh entry, see MeshFileTool::statMeshFile()
+struct MeshSummary
+{
+    struct SubsetSummary {
+        QString name;
+        quint32 count = 0;
+        quint32 offset = 0;
+        Mesh::MeshSubsetBounds bounds;
+    };
+
+    quint32 id = 0;
+    quint64 offset = 0;
+    quint16 fileVersion = 0;
+    quint32 sizeInBytes = 0;
+    quint32 stride = 0;
+    quint32 vertexDataSize = 0;
+    Mesh::ComponentType indexComponentType = Mesh::UnsignedInt32;
+    quint32 indexDataSize = 0;
+    Mesh::DrawMode drawMode = Mesh::Triangles;
+    Mesh::WindingMode windingMode = Mesh::CounterClockwise;
+    QVector<QByteArray> attributeNames;
+    QVector<Mesh::VertexAttribute> vertexLayout;
+    QVector<SubsetSummary> subsets;
+    quint32 jointCount = 0;
+
+    quint32 vertexCount() const { return stride ? vertexDataSize / stride : 0; }
+    quint32 indexCount() const;
+};
+
+class MeshFileTool {
+public:
+    enum LoadMode {
+        Streamed,
+        Mapped
+    };
+
+    // Called from the loading threads with the bytes parsed so far,
+    // returning false cancels the load
+    using ProgressCallback = Mesh::ProgressCallback;
+
+    struct MeshEntry {
+        quint32 id = 0;
+        quint64 offset = 0;
+    };
+
+    MeshFileTool();
+
+    // Reads only the footer, the entries ordered by id. With Mapped the file
+    // is mapped into mapping, when it can be, for loadMeshEntry() to use.
+    QVector<MeshEntry> readMeshEntries(const QString &meshFile, LoadMode loadMode = Mapped,
+                                       QSharedPointer<MeshFileMapping> *mapping = nullptr);
+    // Loads a single entry, from the mapping when there is one. The
+    // progress is that of the entry, see Mesh::ProgressCallback.
+    Mesh *loadMeshEntry(const QString &meshFile, const QSharedPointer<MeshFileMapping> &mapping,
+                        const MeshEntry &entry, quint64 *bytesRead = nullptr,
+                        const Mesh::ProgressCallback &progressCallback = Mesh::ProgressCallback());
+
+    QVector<Mesh *> loadMeshFile(const QString &meshFile, LoadMode loadMode = Mapped,
+                                 const ProgressCallback &progressCallback = ProgressCallback());
+    bool saveMeshFile(const QString &meshFile, const QVector<Mesh *> meshes);
+
+    // Parses only the tables of every mesh entry, skipping the data sections
+    QVector<MeshSummary> statMeshFile(const QString &meshFile);
+
+    // Pool used to load mesh entries in parallel, the global pool when null
+    QThreadPool *threadPool() const;
+    void setThreadPool(QThreadPool *threadPool);
+
+private:
+    struct MultiMeshInfo
+    {
+        quint32 fileId = 0;
+        quint32 fileVersion = 0;
+        QMap<quint32, quint64> meshEntires;
+
+        bool isValid() {
+            return fileId == 555777497 && fileVersion == 1;
+        }
+    };
+
+    static MultiMeshInfo readMultiMeshInfo(QIODevice &device);
+
+    QThreadPool *m_threadPool = nullptr;
+};
+
 #endif // MESH_H
@@ -29,19 +29,65 @@
 #include <QtQml/QQmlFile>
 #include <QtQml/QQmlContext>
 #include <QFileInfo>
+#include <QtConcurrent/QtConcurrentRun>
+
+namespace {
+// Subsets of the reloaded meshes with the same content hash as one of the
+// old subsets take over its decoded attributes and cache key
+void reuseUnchangedSubsets(const QVector<Mesh *> &oldMeshes, const QVector<Mesh *> &newMeshes)
+{
+    // Only the subsets that were decoded were hashed before the change
+    QHash<QByteArray, const Mesh::Subset *> oldSubsets;
+    for (const Mesh *mesh : oldMeshes) {
+        for (const Mesh::Subset *subset : mesh->subsets()) {
+            const QByteArray contentHash = subset->contentHash();
+            if (!contentHash.isEmpty())
+                oldSubsets.insert(contentHash, subset);
+        }
+    }
+    if (oldSubsets.isEmpty())
+        return;
+
+    for (const Mesh *mesh : newMeshes) {
+        for (Mesh::Subset *subset : mesh->subsets()) {
+            const auto it = oldSubsets.constFind(subset->contentHash());
+            if (it != oldSubsets.cend())
+                subset->reuseDecodedData(**it);
+        }
+    }
+}
+}
 
 MeshInfo::MeshInfo(QObject *parent) : QObject(parent)
 {
     m_subsetListModel = new SubsetListModel();
     m_subsetDataTableModel = new SubsetDataTableModel();
+
+    connect(&m_loadWatcher, &QFutureWatcher<void>::progressValueChanged, this, [this](int value) {
+        const int range = m_loadWatcher.progressMaximum() - m_loadWatcher.progressMinimum();
+        if (range > 0)
+            setProgress(qreal(value - m_loadWatcher.progressMinimum()) / range);
+    });
+    connect(&m_loadWatcher, &QFutureWatcher<void>::finished, this, &MeshInfo::handleLoadFinished);
+    m_reloadTimer.setSingleShot(true);
+    m_reloadTimer.setInterval(250);
+    connect(&m_reloadTimer, &QTimer::timeout, this, &MeshInfo::reload);
+    connect(&m_fileWatcher, &QFileSystemWatcher::fileChanged, this, &MeshInfo::handleWatchedPathChanged);
+    connect(&m_fileWatcher, &QFileSystemWatcher::directoryChanged, this, &MeshInfo::handleWatchedPathChanged);
+    // Resetting the table decodes the attributes of the subset
+    connect(m_subsetDataTableModel, &SubsetDataTableModel::modelReset, this, &MeshInfo::updateMemoryUsage);
+    updateMemoryUsage();
 }
 
 MeshInfo::~MeshInfo()
 {
+    m_loadWatcher.disconnect(this);
+    m_loadWatcher.cancel();
+    m_loadWatcher.waitForFinished();
+
     delete m_subsetListModel;
     delete m_subsetDataTableModel;
-    if (!m_meshes.isEmpty())
-        qDeleteAll(m_meshes);
+    qDeleteAll(m_loadedMeshes);
 }
 
 QUrl MeshInfo::meshFile() const
@@ -61,10 +107,7 @@ SubsetDataTableModel *MeshInfo::subsetDataTableModel() const
 
 Mesh *MeshInfo::mesh() const
 {
-    if (m_meshes.isEmpty())
-        return nullptr;
-
-    return m_meshes.first();
+    return m_mesh;
 }
 
 QString MeshInfo::meshName() const
@@ -72,6 +115,127 @@ QString MeshInfo::meshName() const
     return m_meshName;
 }
 
+bool MeshInfo::loading() const
+{
+    return m_loading;
+}
+
+qreal MeshInfo::progress() const
+{
+    return m_progress;
+}
+
+QVariantMap MeshInfo::memoryUsage() const
+{
+    return m_memoryUsage;
+}
+
+bool MeshInfo::watchFile() const
+{
+    return m_watchFile;
+}
+
+void MeshInfo::setWatchFile(bool watchFile)
+{
+    if (m_watchFile == watchFile)
+        return;
+
+    m_watchFile = watchFile;
+    emit watchFileChanged(m_watchFile);
+    updateWatchedPaths();
+}
+
+QList<int> MeshInfo::meshIds() const
+{
+    QList<int> ids;
+    ids.reserve(m_meshEntries.count());
+    for (const auto &entry : m_meshEntries)
+        ids.append(int(entry.id));
+    return ids;
+}
+
+int MeshInfo::meshIndex() const
+{
+    return m_meshIndex;
+}
+
+void MeshInfo::setMeshIndex(int meshIndex)
+{
+    if (m_meshIndex == meshIndex || meshIndex < 0 || meshIndex >= m_meshEntries.count())
+        return;
+
+    // An entry that is still loading is not wanted anymore, a file that is
+    // being opened picks its entry itself
+    if (m_loadJob && !m_loadJob->openFile)
+        cancel();
+    m_meshIndex = meshIndex;
+    emit meshIndexChanged(m_meshIndex);
+    if (m_loadJob)
+        return;
+
+    if (m_loadedMeshes.contains(m_meshIndex)) {
+        showMesh(false);
+        evictMeshes();
+        updateMemoryUsage();
+    } else if (m_mapping && m_mapping->isDetached()) {
+        // The file changed since it was mapped, the entry comes from a reload
+        startLoad(true);
+    } else {
+        startEntryLoad();
+    }
+}
+
+qint64 MeshInfo::memoryBudget() const
+{
+    return m_memoryBudget;
+}
+
+void MeshInfo::setMemoryBudget(qint64 memoryBudget)
+{
+    if (m_memoryBudget == memoryBudget)
+        return;
+
+    m_memoryBudget = memoryBudget;
+    emit memoryBudgetChanged(m_memoryBudget);
+    evictMeshes();
+    updateMemoryUsage();
+}
+
+void MeshInfo::setOverlayGeometryBytes(qint64 bytes)
+{
+    if (m_overlayGeometryBytes == bytes)
+        return;
+
+    m_overlayGeometryBytes = bytes;
+    updateMemoryUsage();
+}
+
+void MeshInfo::updateMemoryUsage()
+{
+    qint64 rawBuffers = 0;
+    qint64 mappedFile = 0;
+    qint64 decodedAttributes = 0;
+    for (const Mesh *mesh : std::as_const(m_loadedMeshes)) {
+        rawBuffers += mesh->rawBufferBytes();
+        mappedFile += mesh->mappedBytes();
+        decodedAttributes += mesh->decodedBytes();
+    }
+    const qint64 modelCaches = m_subsetDataTableModel->cacheBytes();
+
+    QVariantMap memoryUsage;
+    memoryUsage.insert(u"rawBuffers"_qs, rawBuffers);
+    memoryUsage.insert(u"mappedFile"_qs, mappedFile);
+    memoryUsage.insert(u"decodedAttributes"_qs, decodedAttributes);
+    memoryUsage.insert(u"overlayGeometry"_qs, m_overlayGeometryBytes);
+    memoryUsage.insert(u"modelCaches"_qs, modelCaches);
+    memoryUsage.insert(u"total"_qs, rawBuffers + decodedAttributes + m_overlayGeometryBytes + modelCaches);
+    if (memoryUsage == m_memoryUsage)
+        return;
+
+    m_memoryUsage = memoryUsage;
+    emit memoryUsageChanged();
+}
+
 void MeshInfo::setMeshFile(QUrl meshFile)
 {
     if (m_meshFile == meshFile)
@@ -82,6 +246,26 @@ void MeshInfo::setMeshFile(QUrl meshFile)
     updateSourceMeshFile();
 }
 
+void MeshInfo::cancel()
+{
+    if (!m_loadJob)
+        return;
+
+    // The worker notices after the section of the entry it is reading,
+    // anything it already loaded is deleted together with the job
+    const bool openFile = m_loadJob->openFile;
+    m_loadWatcher.cancel();
+    m_loadJob.reset();
+    setLoading(false);
+
+    // Back to the entry that is still shown
+    const int shownIndex = m_loadedMeshes.key(m_mesh, -1);
+    if (!openFile && shownIndex >= 0 && shownIndex != m_meshIndex) {
+        m_meshIndex = shownIndex;
+        emit meshIndexChanged(m_meshIndex);
+    }
+}
+
 void MeshInfo::updateSourceMeshFile()
 {
     const QQmlContext *context = qmlContext(this);
@@ -90,18 +274,228 @@ void MeshInfo::updateSourceMeshFile()
     m_meshName = fileInfo.fileName();
     emit meshNameChanged(m_meshName);
 
-    // Cleanup
-    m_subsetListModel->setMesh(nullptr);
-    m_subsetDataTableModel->setMesh(nullptr);
+    m_meshPath = meshPath;
+    m_reloadTimer.stop();
+    updateWatchedPaths();
+    startLoad(false);
+}
+
+void MeshInfo::reload()
+{
+    if (m_meshPath.isEmpty())
+        return;
+
+    startLoad(!m_loadedMeshes.isEmpty());
+}
+
+void MeshInfo::startLoad(bool reload)
+{
+    // A load that is still running is superseded by this one
+    cancel();
+
+    const QFileInfo fileInfo(m_meshPath);
+    m_fileModified = fileInfo.lastModified();
+    m_fileSize = fileInfo.size();
+
+    auto job = QSharedPointer<LoadJob>::create();
+    job->reload = reload;
+    // A reload stays on the entry that is shown, when it still exists
+    if (reload && m_meshIndex < m_meshEntries.count())
+        job->meshId = m_meshEntries.at(m_meshIndex).id;
+    if (!reload) {
+        setProgress(0.0);
+        setLoading(true);
+    }
+    runLoadJob(job);
+}
+
+void MeshInfo::startEntryLoad()
+{
+    auto job = QSharedPointer<LoadJob>::create();
+    job->openFile = false;
+    job->mapping = m_mapping;
+    job->entries = m_meshEntries;
+    job->entryIndex = m_meshIndex;
+    setProgress(0.0);
+    setLoading(true);
+    runLoadJob(job);
+}
+
+void MeshInfo::runLoadJob(const QSharedPointer<LoadJob> &job)
+{
+    m_loadJob = job;
+
+    // The worker gets its own copy of the tool, a superseded load can still
+    // be running when this MeshInfo is destroyed
+    const MeshFileTool meshFileTool = m_meshFileTool;
+    const QString meshPath = m_meshPath;
+    QFuture<void> future = QtConcurrent::run([job, meshPath, meshFileTool](QPromise<void> &promise) {
+        // Per mille of the entry, which reports after each of its sections
+        promise.setProgressRange(0, 1000);
+        MeshFileTool tool = meshFileTool;
+        if (job->openFile) {
+            job->entries = tool.readMeshEntries(meshPath, MeshFileTool::Mapped, &job->mapping);
+            for (int i = 0; i < job->entries.count(); ++i) {
+                if (job->entries.at(i).id == job->meshId)
+                    job->entryIndex = i;
+            }
+        }
+        if (promise.isCanceled() || job->entryIndex >= job->entries.count())
+            return;
 
-    if (!m_meshes.isEmpty())
-        qDeleteAll(m_meshes);
+        auto progress = [&promise](qint64 bytesRead, qint64 bytesTotal) {
+            if (bytesTotal > 0)
+                promise.setProgressValue(int(bytesRead * 1000 / bytesTotal));
+            return !promise.isCanceled();
+        };
+        job->mesh = tool.loadMeshEntry(meshPath, job->mapping, job->entries.at(job->entryIndex), nullptr, progress);
+    });
+    m_loadWatcher.setFuture(future);
+}
+
+void MeshInfo::handleLoadFinished()
+{
+    if (m_loadWatcher.isCanceled() || !m_loadWatcher.isFinished() || !m_loadJob)
+        return;
 
-    m_meshes = m_meshFileTool.loadMeshFile(meshPath);
+    const QSharedPointer<LoadJob> job = m_loadJob;
+    m_loadJob.reset();
+    setProgress(1.0);
+    setLoading(false);
 
-    if (!m_meshes.isEmpty()) {
-        m_subsetListModel->setMesh(m_meshes.first());
-        m_subsetDataTableModel->setMesh(m_meshes.first());
+    if (!job->openFile) {
+        // Dropped when the file was opened again in the meantime
+        if (!job->mesh || job->mapping != m_mapping)
+            return;
+        m_loadedMeshes.insert(job->entryIndex, job->mesh);
+        job->mesh = nullptr;
+        if (job->entryIndex == m_meshIndex)
+            showMesh(false);
+    } else {
+        if (job->reload && !job->mesh) {
+            // Most likely read while the exporter was still writing, the
+            // next change of the file triggers another reload
+            return;
+        }
+
+        const QVector<Mesh *> oldMeshes = m_loadedMeshes.values();
+        m_loadedMeshes.clear();
+        m_recentEntries.clear();
+        m_mapping = job->mapping;
+        m_meshEntries = job->entries;
+        if (job->mesh) {
+            m_loadedMeshes.insert(job->entryIndex, job->mesh);
+            job->mesh = nullptr;
+        }
+        if (job->reload)
+            reuseUnchangedSubsets(oldMeshes, m_loadedMeshes.values());
+        emit meshIdsChanged();
+        if (m_meshIndex != job->entryIndex) {
+            m_meshIndex = job->entryIndex;
+            emit meshIndexChanged(m_meshIndex);
+        }
+        showMesh(job->reload);
+
+        // Only deleted once nothing refers to the old meshes anymore
+        qDeleteAll(oldMeshes);
     }
+
+    evictMeshes();
+    updateMemoryUsage();
+}
+
+void MeshInfo::showMesh(bool reload)
+{
+    m_mesh = m_loadedMeshes.value(m_meshIndex);
+    if (reload)
+        m_subsetListModel->updateMesh(m_mesh);
+    else
+        m_subsetListModel->setMesh(m_mesh);
+    m_subsetDataTableModel->setMesh(m_mesh);
+
+    m_recentEntries.removeAll(m_meshIndex);
+    if (m_mesh)
+        m_recentEntries.append(m_meshIndex);
     emit meshesUpdated();
 }
+
+void MeshInfo::evictMeshes()
+{
+    // Mapped data is left out, the OS pages it in and out as needed
+    auto meshBytes = [](const Mesh *mesh) {
+        return mesh->rawBufferBytes() + mesh->decodedBytes();
+    };
+    qint64 total = 0;
+    for (const Mesh *mesh : std::as_const(m_loadedMeshes))
+        total += meshBytes(mesh);
+
+    for (int i = 0; i < m_recentEntries.count() && total > m_memoryBudget;) {
+        const int entryIndex = m_recentEntries.at(i);
+        Mesh *mesh = m_loadedMeshes.value(entryIndex);
+        if (mesh == m_mesh || entryIndex == m_meshIndex) {
+            ++i;
+            continue;
+        }
+        total -= meshBytes(mesh);
+        m_loadedMeshes.remove(entryIndex);
+        m_recentEntries.removeAt(i);
+        delete mesh;
+    }
+}
+
+void MeshInfo::updateWatchedPaths()
+{
+    const QStringList watchedPaths = m_fileWatcher.files() + m_fileWatcher.directories();
+    if (!watchedPaths.isEmpty())
+        m_fileWatcher.removePaths(watchedPaths);
+
+    // Files in resources never change
+    if (!m_watchFile || m_meshPath.isEmpty() || m_meshPath.startsWith(u':'))
+        return;
+
+    // Exporters that replace the file drop it from the watcher,
+    // the directory notices when it comes back
+    const QFileInfo fileInfo(m_meshPath);
+    m_fileWatcher.addPath(fileInfo.absolutePath());
+    if (fileInfo.exists())
+        m_fileWatcher.addPath(m_meshPath);
+}
+
+void MeshInfo::handleWatchedPathChanged()
+{
+    const QFileInfo fileInfo(m_meshPath);
+    if (!fileInfo.exists())
+        return;
+    if (!m_fileWatcher.files().contains(m_meshPath))
+        m_fileWatcher.addPath(m_meshPath);
+
+    // Other files in the directory changed
+    if (fileInfo.lastModified() == m_fileModified && fileInfo.size() == m_fileSize)
+        return;
+
+    // The shown meshes stop reading the file while it is being written,
+    // an entry that is loading from it is not wanted anymore
+    if (m_mapping)
+        m_mapping->detach();
+    if (m_loadJob && !m_loadJob->openFile)
+        cancel();
+    m_reloadTimer.start();
+}
+
+void MeshInfo::setLoading(bool loading)
+{
+    if (m_loading == loading)
+        return;
+
+    m_loading = loading;
+    emit loadingChanged(m_loading);
+}
+
+void MeshInfo::setProgress(qreal progress)
+{
+    if (qFuzzyCompare(m_progress, progress))
+        return;
+
+    m_progress = progress;
+    emit progressChanged(m_progress);
+}
@@ -27,7 +27,11 @@
 #ifndef MESHINFO_H
 #define MESHINFO_H
 
+#include <QDateTime>
 #include <QObject>
+#include <QFileSystemWatcher>
+#include <QFutureWatcher>
+#include <QTimer>
 #include <qqml.h>
 
 #include "subsetlistmodel.h"
@@ -41,6 +45,13 @@ class MeshInfo : public QObject
     Q_PROPERTY(SubsetListModel* subsetListModel READ subsetListModel NOTIFY subsetListModelChanged)
     Q_PROPERTY(SubsetDataTableModel* subsetDataTableModel READ subsetDataTableModel NOTIFY subsetDataTableModelChanged)
     Q_PROPERTY(QString meshName READ meshName NOTIFY meshNameChanged)
+    Q_PROPERTY(bool loading READ loading NOTIFY loadingChanged)
+    Q_PROPERTY(qreal progress READ progress NOTIFY progressChanged)
+    Q_PROPERTY(QVariantMap memoryUsage READ memoryUsage NOTIFY memoryUsageChanged)
+    Q_PROPERTY(bool watchFile READ watchFile WRITE setWatchFile NOTIFY watchFileChanged)
+    Q_PROPERTY(QList<int> meshIds READ meshIds NOTIFY meshIdsChanged)
+    Q_PROPERTY(int meshIndex READ meshIndex WRITE setMeshIndex NOTIFY meshIndexChanged)
+    Q_PROPERTY(qint64 memoryBudget READ memoryBudget WRITE setMemoryBudget NOTIFY memoryBudgetChanged)
     QML_ELEMENT
 public:
     explicit MeshInfo(QObject *parent = nullptr);
@@ -50,11 +61,38 @@ public:
     SubsetListModel* subsetListModel() const;
     SubsetDataTableModel* subsetDataTableModel() const;
 
+    // The entry shown by the models
     Mesh *mesh() const;
     QString meshName() const;
+    bool loading() const;
+    qreal progress() const;
+    // Bytes per category: rawBuffers, mappedFile, decodedAttributes,
+    // overlayGeometry, modelCaches and total (everything but mappedFile)
+    QVariantMap memoryUsage() const;
+
+    // Reported by the GeometryGenerator showing this mesh
+    void setOverlayGeometryBytes(qint64 bytes);
+
+    // Reloads the file when it is written again, subsets that did not
+    // change keep their decoded attributes and generated geometry
+    bool watchFile() const;
+
+    // Ids of all entries in the file. Opening a file only reads the footer
+    // and the first entry, the others are loaded when they are picked.
+    QList<int> meshIds() const;
+    int meshIndex() const;
+    // Entries that are not shown are deleted, least recently shown
+    // first, once the loaded ones hold more memory than this
+    qint64 memoryBudget() const;
 
 public slots:
     void setMeshFile(QUrl meshFile);
+    void cancel();
+    void reload();
+    void updateMemoryUsage();
+    void setWatchFile(bool watchFile);
+    void setMeshIndex(int meshIndex);
+    void setMemoryBudget(qint64 memoryBudget);
 
 signals:
     void meshFileChanged(QUrl meshFile);
@@ -62,15 +100,68 @@ signals:
     void subsetDataTableModelChanged(SubsetDataTableModel* subsetDataTableModel);
     void meshesUpdated();
     void meshNameChanged(QString meshName);
+    void loadingChanged(bool loading);
+    void progressChanged(qreal progress);
+    void memoryUsageChanged();
+    void watchFileChanged(bool watchFile);
+    void meshIdsChanged();
+    void meshIndexChanged(int meshIndex);
+    void memoryBudgetChanged(qint64 memoryBudget);
 
 private:
+    // Shared between the GUI thread and the worker loading the file,
+    // meshes that are never picked up are deleted with the job
+    struct LoadJob {
+        ~LoadJob() { delete mesh; }
+        // Opening reads the footer before loading the entry
+        bool openFile = true;
+        // Replaces the meshes of the same file, without the loading indicator
+        bool reload = false;
+        // Entry to show after opening, the first one when the file has no such id
+        qint64 meshId = -1;
+        QSharedPointer<MeshFileMapping> mapping;
+        QVector<MeshFileTool::MeshEntry> entries;
+        int entryIndex = 0;
+        Mesh *mesh = nullptr;
+    };
+
     void updateSourceMeshFile();
+    void startLoad(bool reload);
+    void startEntryLoad();
+    void runLoadJob(const QSharedPointer<LoadJob> &job);
+    void handleLoadFinished();
+    void showMesh(bool reload);
+    void evictMeshes();
+    void updateWatchedPaths();
+    void handleWatchedPathChanged();
+    void setLoading(bool loading);
+    void setProgress(qreal progress);
     QUrl m_meshFile;
     SubsetListModel* m_subsetListModel = nullptr;
     SubsetDataTableModel* m_subsetDataTableModel = nullptr;
-    QVector<Mesh *> m_meshes;
+    QSharedPointer<MeshFileMapping> m_mapping;
+    QVector<MeshFileTool::MeshEntry> m_meshEntries;
+    // Loaded entries by index, m_recentEntries has the least recently shown first
+    QHash<int, Mesh *> m_loadedMeshes;
+    QVector<int> m_recentEntries;
+    Mesh *m_mesh = nullptr;
+    int m_meshIndex = 0;
+    qint64 m_memoryBudget = qint64(1024) * 1024 * 1024;
     MeshFileTool m_meshFileTool;
     QString m_meshName;
+    QString m_meshPath;
+    QDateTime m_fileModified;
+    qint64 m_fileSize = -1;
+    QFutureWatcher<void> m_loadWatcher;
+    QSharedPointer<LoadJob> m_loadJob;
+    bool m_loading = false;
+    qreal m_progress = 0.0;
+    qint64 m_overlayGeometryBytes = 0;
+    QVariantMap m_memoryUsage;
+    bool m_watchFile = true;
+    QFileSystemWatcher m_fileWatcher;
+    // Exporters write in several steps, the reload waits for them to settle
+    QTimer m_reloadTimer;
 };
 
 #endif // MESHINFO_H
@@ -1,4 +1,6 @@
 #include "meshviewerapplication.h"
+#include "diskcache.h"
+#include "tracing.h"
 
 #include <QtGui/QFontDatabase>
 
@@ -25,6 +27,8 @@ MeshViewerApplication::MeshViewerApplication(int &argc, char **argv, const QStri
     : m_application(createApplication(argc, argv, applicationName))
     , m_qmlEngine(new QQmlApplicationEngine)
 {
+    Tracing::enableFromEnvironment();
+    DiskCache::configureFromEnvironment();
     QSurfaceFormat::setDefaultFormat(QQuick3D::idealSurfaceFormat());
 
     // Extra File Selectors for native features
@@ -52,7 +56,10 @@ MeshViewerApplication::~MeshViewerApplication()
 
 int MeshViewerApplication::run()
 {
-    return m_application->exec();
+    const int result = m_application->exec();
+    DiskCache::waitForPendingWrites();
+    Tracing::writeTraceFromEnvironment();
+    return result;
 }
 
 QQmlApplicationEngine *MeshViewerApplication::qmlEngine() const
@@ -0,0 +1,496 @@
+/*
+ * Copyright (c) 2023 Andy Nichols <nezticle@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QtTest>
+#include <QGuiApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QThreadPool>
+
+#include "geometrygenerator.h"
+#include "mesh.h"
+#include "subsetdatatablemodel.h"
+#include "syntheticmesh.h"
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#ifndef MESHVIEWER_BENCHMARK_FIXTURES
+#define MESHVIEWER_BENCHMARK_FIXTURES "fixtures"
+#endif
+
+namespace {
+qint64 peakResidentSetSize()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(Q_OS_DARWIN)
+    return usage.ru_maxrss;
+#else
+    // Kilobytes everywhere else
+    return qint64(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// A new geometry object set up like the published one, as the generator
+// made for every subset before it kept its objects
+QQuick3DGeometry *copyGeometry(const QQuick3DGeometry *source)
+{
+    if (!source)
+        return nullptr;
+    auto geometry = new QQuick3DGeometry;
+    geometry->setStride(source->stride());
+    geometry->setPrimitiveType(source->primitiveType());
+    geometry->setBounds(source->boundsMin(), source->boundsMax());
+    for (int i = 0; i < source->attributeCount(); ++i)
+        geometry->addAttribute(source->attribute(i));
+    geometry->setVertexData(source->vertexData());
+    geometry->setIndexData(source->indexData());
+    geometry->update();
+    return geometry;
+}
+}
+
+// Times each stage between a .mesh file and what is shown on screen, on
+// synthetic meshes of increasing size and on the meshes found in the
+// fixtures directory. Next to the usual QTest output the throughput and
+// peak RSS of every run are written as JSON to MESHVIEWER_BENCHMARK_OUTPUT,
+// meshviewer-benchmarks.json by default.
+class MeshViewerBenchmarks : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void loadMeshFile_data();
+    void loadMeshFile();
+    void subsetConstructor_data() { addMeshFiles(); }
+    void subsetConstructor();
+    void subsetDecode_data() { addMeshFiles(); }
+    void subsetDecode();
+    void generateOriginalGeometry_data() { addMeshFiles(); }
+    void generateOriginalGeometry();
+    void generateCompactGeometry_data() { addMeshFiles(); }
+    void generateCompactGeometry();
+    void generateWireframeGeometry_data() { addMeshFiles(); }
+    void generateWireframeGeometry();
+    void generateNormalGeometry_data() { addMeshFiles(); }
+    void generateNormalGeometry();
+    void generateTangentGeometry_data() { addMeshFiles(); }
+    void generateTangentGeometry();
+    void generateBinormalGeometry_data() { addMeshFiles(); }
+    void generateBinormalGeometry();
+    void subsetCycling_data();
+    void subsetCycling();
+    void tableModelUpdate_data() { addMeshFiles(); }
+    void tableModelUpdate();
+    void tableModelData_data() { addMeshFiles(); }
+    void tableModelData();
+
+private:
+    void addMeshFiles();
+    Mesh *loadedMesh(const QString &meshFile);
+    void benchmarkGeometry(GeometryGenerator::GeometryKind kind, bool compact = false);
+    void record(qint64 nanoseconds, qint64 iterations, qint64 vertices, qint64 bytes);
+
+    QTemporaryDir m_directory;
+    QStringList m_meshFiles;
+    // Only used for loading, its entries are what is loaded in parallel
+    QString m_multiMeshFile;
+    QHash<QString, QVector<Mesh *>> m_loadedMeshes;
+    QJsonArray m_results;
+};
+
+void MeshViewerBenchmarks::initTestCase()
+{
+    QVERIFY(m_directory.isValid());
+
+    static const quint32 vertexCounts[] = { 1024, 16384, 262144, 1048576 };
+    for (quint32 vertexCount : vertexCounts) {
+        SyntheticMesh::Options options;
+        options.vertexCount = vertexCount;
+        options.colors = true;
+        QScopedPointer<Mesh> mesh(SyntheticMesh::create(options));
+        const QString meshFile = m_directory.filePath(QStringLiteral("synthetic-%1.mesh").arg(vertexCount));
+        MeshFileTool meshFileTool;
+        QVERIFY(meshFileTool.saveMeshFile(meshFile, { mesh.data() }));
+        m_meshFiles.append(meshFile);
+    }
+
+    QVector<Mesh *> meshes;
+    for (int i = 0; i < 16; ++i) {
+        SyntheticMesh::Options options;
+        options.vertexCount = 16384;
+        options.colors = true;
+        meshes.append(SyntheticMesh::create(options));
+    }
+    m_multiMeshFile = m_directory.filePath(QStringLiteral("synthetic-16x16384.mesh"));
+    MeshFileTool meshFileTool;
+    const bool saved = meshFileTool.saveMeshFile(m_multiMeshFile, meshes);
+    qDeleteAll(meshes);
+    QVERIFY(saved);
+
+    const QString fixtures = qEnvironmentVariable("MESHVIEWER_BENCHMARK_FIXTURES",
+                                                  QStringLiteral(MESHVIEWER_BENCHMARK_FIXTURES));
+    QDirIterator it(fixtures, { QStringLiteral("*.mesh") }, QDir::Files);
+    QStringList fixtureFiles;
+    while (it.hasNext())
+        fixtureFiles.append(it.next());
+    fixtureFiles.sort();
+    m_meshFiles.append(fixtureFiles);
+}
+
+void MeshViewerBenchmarks::cleanupTestCase()
+{
+    for (const auto &meshes : std::as_const(m_loadedMeshes))
+        qDeleteAll(meshes);
+    m_loadedMeshes.clear();
+
+    const QJsonObject report {
+        { QStringLiteral("qtVersion"), QString::fromLatin1(qVersion()) },
+        { QStringLiteral("peakRssBytes"), peakResidentSetSize() },
+        { QStringLiteral("results"), m_results }
+    };
+    QFile output(qEnvironmentVariable("MESHVIEWER_BENCHMARK_OUTPUT", QStringLiteral("meshviewer-benchmarks.json")));
+    QVERIFY(output.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    output.write(QJsonDocument(report).toJson());
+}
+
+void MeshViewerBenchmarks::loadMeshFile_data()
+{
+    // Every file with the entries loaded by one thread up to all cores
+    QTest::addColumn<QString>("meshFile");
+    QTest::addColumn<int>("threads");
+    QList<int> threadCounts;
+    for (int threads = 1; threads < QThread::idealThreadCount(); threads *= 2)
+        threadCounts.append(threads);
+    threadCounts.append(QThread::idealThreadCount());
+    QStringList meshFiles = m_meshFiles;
+    meshFiles.append(m_multiMeshFile);
+    for (const QString &meshFile : std::as_const(meshFiles)) {
+        for (int threads : std::as_const(threadCounts)) {
+            const QString tag = QStringLiteral("%1-%2threads").arg(QFileInfo(meshFile).completeBaseName()).arg(threads);
+            QTest::newRow(qPrintable(tag)) << meshFile << threads;
+        }
+    }
+}
+
+void MeshViewerBenchmarks::loadMeshFile()
+{
+    QFETCH(QString, meshFile);
+    QFETCH(int, threads);
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    MeshFileTool meshFileTool;
+    meshFileTool.setThreadPool(&pool);
+    const qint64 bytes = QFileInfo(meshFile).size();
+    qint64 vertices = 0;
+
+    QElapsedTimer timer;
+    qint64 iterations = 0;
+    timer.start();
+    QBENCHMARK {
+        const QVector<Mesh *> meshes = meshFileTool.loadMeshFile(meshFile);
+        vertices = 0;
+        for (const Mesh *mesh : meshes) {
+            vertices += mesh->vertexCount();
+        }
+        qDeleteAll(meshes);
+        ++iterations;
+    }
+    record(timer.nsecsElapsed(), iterations, vertices, bytes);
+}
+
+void MeshViewerBenchmarks::subsetConstructor()
+{
+    QFETCH(QString, meshFile);
+    Mesh *mesh = loadedMesh(meshFile);
+    QVERIFY(mesh);
+
+    QElapsedTimer timer;
+    qint64 iterations = 0;
+    qint64 vertices = 0;
+    timer.start();
+    QBENCHMARK {
+        vertices = 0;
+        for (int i = 0; i < mesh->subsets().count(); ++i) {
+            Mesh::Subset subset(*mesh, i);
+            vertices += subset.count();
+        }
+        ++iterations;
+    }
+    record(timer.nsecsElapsed(), iterations, vertices, 0);
+}
+
+void MeshViewerBenchmarks::subsetDecode()
+{
+    QFETCH(QString, meshFile);
+    Mesh *mesh = loadedMesh(meshFile);
+    QVERIFY(mesh);
+
+    QElapsedTimer timer;
+    qint64 iterations = 0;
+    qint64 vertices = 0;
+    timer.start();
+    QBENCHMARK {
+        vertices = 0;
+        for (int i = 0; i < mesh->subsets().count(); ++i) {
+            Mesh::Subset subset(*mesh, i);
+            subset.positions();
+            subset.normals();
+            subset.uvs();
+            subset.tangents();
+            subset.binormals();
+            subset.colors();
+            vertices += subset.count();
+        }
+        ++iterations;
+    }
+    record(timer.nsecsElapsed(), iterations, vertices, vertices * mesh->vertexStride());
+}
+
+void MeshViewerBenchmarks::generateOriginalGeometry()
+{
+    benchmarkGeometry(GeometryGenerator::OriginalGeometry);
+}
+
+void MeshViewerBenchmarks::generateCompactGeometry()
+{
+    benchmarkGeometry(GeometryGenerator::OriginalGeometry, true);
+}
+
+void MeshViewerBenchmarks::generateWireframeGeometry()
+{
+    benchmarkGeometry(GeometryGenerator::WireframeGeometry);
+}
+
+void MeshViewerBenchmarks::generateNormalGeometry()
+{
+    benchmarkGeometry(GeometryGenerator::NormalGeometry);
+}
+
+void MeshViewerBenchmarks::generateTangentGeometry()
+{
+    benchmarkGeometry(GeometryGenerator::TangentGeometry);
+}
+
+void MeshViewerBenchmarks::generateBinormalGeometry()
+{
+    benchmarkGeometry(GeometryGenerator::BinormalGeometry);
+}
+
+void MeshViewerBenchmarks::subsetCycling_data()
+{
+    QTest::addColumn<quint32>("vertexCount");
+    QTest::addColumn<bool>("replaceObjects");
+    // The replaced rows also create new geometry objects for every subset,
+    // as the generator did before it kept them
+    for (quint32 vertexCount : { 16384u, 262144u }) {
+        QTest::newRow(qPrintable(QStringLiteral("synthetic-%1").arg(vertexCount))) << vertexCount << false;
+        QTest::newRow(qPrintable(QStringLiteral("synthetic-%1-replaced").arg(vertexCount))) << vertexCount << true;
+    }
+}
+
+void MeshViewerBenchmarks::subsetCycling()
+{
+    QFETCH(quint32, vertexCount);
+    QFETCH(bool, replaceObjects);
+    SyntheticMesh::Options options;
+    options.vertexCount = vertexCount;
+    options.subsetCount = 16;
+    QScopedPointer<Mesh> mesh(SyntheticMesh::create(options));
+    const QVector<Mesh::Subset *> subsets = mesh->subsets();
+
+    GeometryGenerator generator;
+    generator.setWireframeEnabled(true);
+    generator.setNormalsEnabled(true);
+    generator.setTangentsEnabled(true);
+    generator.setBinormalsEnabled(true);
+    // Every subset is generated once, the measurement is what going back
+    // to a cached subset costs, publishing its geometry included
+    QSignalSpy published(&generator, &GeometryGenerator::geometriesPublished);
+    for (Mesh::Subset *subset : subsets) {
+        published.clear();
+        generator.setSubset(subset);
+        QTRY_VERIFY(!published.isEmpty());
+    }
+
+    QElapsedTimer timer;
+    qint64 iterations = 0;
+    qint64 vertices = 0;
+    QScopedPointer<QQuick3DGeometry> original;
+    QScopedPointer<QQuick3DGeometry> wireframe;
+    timer.start();
+    QBENCHMARK {
+        vertices = 0;
+        for (Mesh::Subset *subset : subsets) {
+            generator.setSubset(subset);
+            if (replaceObjects) {
+                original.reset(copyGeometry(generator.original()));
+                wireframe.reset(copyGeometry(generator.wireframe()));
+            }
+            vertices += subset->count();
+        }
+        ++iterations;
+    }
+    record(timer.nsecsElapsed(), iterations, vertices, generator.cacheSize());
+    generator.setSubset(nullptr);
+}
+
+void MeshViewerBenchmarks::tableModelUpdate()
+{
+    QFETCH(QString, meshFile);
+    Mesh *mesh = loadedMesh(meshFile);
+    QVERIFY(mesh);
+    SubsetDataTableModel model;
+    model.setMesh(mesh);
+
+    QElapsedTimer timer;
+    qint64 iterations = 0;
+    timer.start();
+    QBENCHMARK {
+        model.updateModelData();
+        ++iterations;
+    }
+    record(timer.nsecsElapsed(), iterations, model.rowCount(QModelIndex()), 0);
+}
+
+void MeshViewerBenchmarks::tableModelData()
+{
+    QFETCH(QString, meshFile);
+    Mesh *mesh = loadedMesh(meshFile);
+    QVERIFY(mesh);
+    SubsetDataTableModel model;
+    model.setMesh(mesh);
+
+    // Only a window of rows is ever visible, a bounded number is plenty
+    const int rows = qMin(model.rowCount(QModelIndex()), 65536);
+    const int columns = model.columnCount(QModelIndex());
+
+    QElapsedTimer timer;
+    qint64 iterations = 0;
+    timer.start();
+    QBENCHMARK {
+        for (int row = 0; row < rows; ++row) {
+            for (int column = 0; column < columns; ++column)
+                model.data(model.index(row, column), Qt::DisplayRole);
+        }
+        ++iterations;
+    }
+    record(timer.nsecsElapsed(), iterations, rows, 0);
+}
+
+void MeshViewerBenchmarks::addMeshFiles()
+{
+    QTest::addColumn<QString>("meshFile");
+    for (const QString &meshFile : std::as_const(m_meshFiles))
+        QTest::newRow(qPrintable(QFileInfo(meshFile).completeBaseName())) << meshFile;
+}
+
+Mesh *MeshViewerBenchmarks::loadedMesh(const QString &meshFile)
+{
+    auto it = m_loadedMeshes.find(meshFile);
+    if (it == m_loadedMeshes.end()) {
+        MeshFileTool meshFileTool;
+        it = m_loadedMeshes.insert(meshFile, meshFileTool.loadMeshFile(meshFile));
+    }
+    return it->isEmpty() ? nullptr : it->first();
+}
+
+void MeshViewerBenchmarks::benchmarkGeometry(GeometryGenerator::GeometryKind kind, bool compact)
+{
+    QFETCH(QString, meshFile);
+    Mesh *mesh = loadedMesh(meshFile);
+    QVERIFY(mesh);
+    QVERIFY(!mesh->subsets().isEmpty());
+    Mesh::Subset *subset = mesh->subsets().first();
+    if (subset->drawMode() != Mesh::Triangles)
+        QSKIP("Geometry is only generated for triangles");
+
+    // Attributes are decoded once, outside of the measurement.
+    // The cache is bypassed so every iteration does the full generation.
+    const GeometryGenerator::SubsetData data = GeometryGenerator::subsetData(subset, compact);
+
+    QElapsedTimer timer;
+    qint64 iterations = 0;
+    qint64 bytes = 0;
+    timer.start();
+    QBENCHMARK {
+        bytes = GeometryGenerator::generateGeometry(kind, data).bytes();
+        ++iterations;
+    }
+    record(timer.nsecsElapsed(), iterations, subset->count(), bytes);
+}
+
+void MeshViewerBenchmarks::record(qint64 nanoseconds, qint64 iterations, qint64 vertices, qint64 bytes)
+{
+    if (iterations == 0 || nanoseconds == 0)
+        return;
+
+    const double secondsPerIteration = nanoseconds / 1e9 / iterations;
+    QJsonObject result {
+        { QStringLiteral("benchmark"), QString::fromLatin1(QTest::currentTestFunction()) },
+        { QStringLiteral("data"), QString::fromLatin1(QTest::currentDataTag()) },
+        { QStringLiteral("iterations"), iterations },
+        { QStringLiteral("nsPerIteration"), nanoseconds / double(iterations) },
+        { QStringLiteral("vertices"), vertices },
+        { QStringLiteral("verticesPerSecond"), vertices / secondsPerIteration },
+        { QStringLiteral("peakRssBytes"), peakResidentSetSize() }
+    };
+    if (bytes > 0) {
+        result.insert(QStringLiteral("bytes"), bytes);
+        result.insert(QStringLiteral("bytesPerSecond"), bytes / secondsPerIteration);
+    }
+    m_results.append(result);
+}
+
+int main(int argc, char *argv[])
+{
+    // Nothing is rendered, so there is no need for a display
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+    MeshViewerBenchmarks benchmarks;
+    return QTest::qExec(&benchmarks, argc, argv);
+}
+
+#include "meshviewerbenchmarks.moc"
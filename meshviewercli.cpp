@@ -0,0 +1,475 @@
+/*
+ * Copyright (c) 2023 Andy Nichols <nezticle@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "meshviewercli.h"
+#include "mesh.h"
+#include "tracing.h"
+
+#include <QCommandLineParser>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentMap>
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+
+namespace {
+
+QString componentTypeName(Mesh::ComponentType componentType)
+{
+    switch (componentType) {
+    case Mesh::UnsignedInt8: return u"uint8"_qs;
+    case Mesh::Int8: return u"int8"_qs;
+    case Mesh::UnsignedInt16: return u"uint16"_qs;
+    case Mesh::Int16: return u"int16"_qs;
+    case Mesh::UnsignedInt32: return u"uint32"_qs;
+    case Mesh::Int32: return u"int32"_qs;
+    case Mesh::UnsignedInt64: return u"uint64"_qs;
+    case Mesh::Int64: return u"int64"_qs;
+    case Mesh::Float16: return u"float16"_qs;
+    case Mesh::Float32: return u"float32"_qs;
+    case Mesh::Float64: return u"float64"_qs;
+    }
+    return u"unknown"_qs;
+}
+
+QString drawModeName(Mesh::DrawMode drawMode)
+{
+    switch (drawMode) {
+    case Mesh::Points: return u"points"_qs;
+    case Mesh::LineStrip: return u"lineStrip"_qs;
+    case Mesh::LineLoop: return u"lineLoop"_qs;
+    case Mesh::Lines: return u"lines"_qs;
+    case Mesh::TriangleStrip: return u"triangleStrip"_qs;
+    case Mesh::TriangleFan: return u"triangleFan"_qs;
+    case Mesh::Triangles: return u"triangles"_qs;
+    case Mesh::Patches: return u"patches"_qs;
+    }
+    return u"unknown"_qs;
+}
+
+QString windingModeName(Mesh::WindingMode windingMode)
+{
+    return windingMode == Mesh::Clockwise ? u"clockwise"_qs : u"counterClockwise"_qs;
+}
+
+QJsonArray toJson(const QVector3D &vector)
+{
+    return QJsonArray { vector.x(), vector.y(), vector.z() };
+}
+
+QJsonObject toJson(const Mesh::MeshSubsetBounds &bounds)
+{
+    return QJsonObject {
+        { u"min"_qs, toJson(bounds.min) },
+        { u"max"_qs, toJson(bounds.max) }
+    };
+}
+
+// Flattens the first limit values, all of them when limit is negative
+template <typename T>
+QJsonArray toJson(const QVector<T> &values, int components, int limit)
+{
+    const int count = limit < 0 ? values.count() : qMin(limit, int(values.count()));
+    QJsonArray array;
+    for (int i = 0; i < count; ++i) {
+        for (int j = 0; j < components; ++j)
+            array.append(values.at(i)[j]);
+    }
+    return array;
+}
+
+// Decodes every attribute of the subset, returns the number of vertexes
+quint64 decodeSubset(const Mesh::Subset *subset)
+{
+    subset->positions();
+    subset->normals();
+    subset->uvs();
+    subset->tangents();
+    subset->binormals();
+    subset->colors();
+    subset->joints();
+    subset->weights();
+    subset->morphTargetPositions();
+    subset->morphTargetNormals();
+    subset->morphTargetTangents();
+    subset->morphTargetBinormals();
+    return subset->count();
+}
+
+double toMilliseconds(qint64 nanoseconds)
+{
+    return nanoseconds / 1000000.0;
+}
+
+double perSecond(double amount, qint64 nanoseconds)
+{
+    return nanoseconds > 0 ? amount * 1000000000.0 / nanoseconds : 0.0;
+}
+
+}
+
+int MeshViewerCli::run(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription(u"Inspects .mesh files without a display, writing one JSON object per line."_qs);
+    parser.addHelpOption();
+    parser.addPositionalArgument(u"command"_qs, u"info, validate, dump or bench"_qs);
+    parser.addPositionalArgument(u"paths"_qs, u"Mesh files, or directories searched for .mesh files"_qs, u"paths..."_qs);
+    QCommandLineOption threadsOption({ u"j"_qs, u"threads"_qs },
+                                     u"Number of worker threads, one per core by default."_qs, u"count"_qs);
+    QCommandLineOption limitOption(u"limit"_qs, u"dump: maximum number of vertexes written per subset."_qs, u"count"_qs);
+    QCommandLineOption iterationsOption(u"iterations"_qs, u"bench: number of runs, the fastest one is reported."_qs,
+                                        u"count"_qs, u"3"_qs);
+    QCommandLineOption traceOption(u"trace"_qs, u"Writes the timing of every phase to a Chrome trace file."_qs,
+                                   u"file"_qs);
+    parser.addOption(threadsOption);
+    parser.addOption(limitOption);
+    parser.addOption(iterationsOption);
+    parser.addOption(traceOption);
+    parser.process(arguments);
+
+    const QStringList positionalArguments = parser.positionalArguments();
+    if (positionalArguments.count() < 2)
+        parser.showHelp(2);
+
+    static const QMap<QString, Command> commands = {
+        { u"info"_qs, Info },
+        { u"validate"_qs, Validate },
+        { u"dump"_qs, Dump },
+        { u"bench"_qs, Bench }
+    };
+    const auto command = commands.constFind(positionalArguments.first());
+    if (command == commands.cend()) {
+        fprintf(stderr, "Unknown command: %s\n", qPrintable(positionalArguments.first()));
+        parser.showHelp(2);
+    }
+
+    if (parser.isSet(limitOption))
+        m_dumpLimit = parser.value(limitOption).toInt();
+    m_benchIterations = qMax(1, parser.value(iterationsOption).toInt());
+
+    QStringList missing;
+    QStringList files = collectFiles(positionalArguments.mid(1), &missing);
+    for (const QString &path : std::as_const(missing)) {
+        writeLine({ { u"file"_qs, path }, { u"error"_qs, u"no such file or directory"_qs } });
+        ++m_failures;
+    }
+
+    QThreadPool filePool;
+    if (parser.isSet(threadsOption))
+        filePool.setMaxThreadCount(qMax(1, parser.value(threadsOption).toInt()));
+    // With several files every thread already works on a file of its own, the
+    // entries of a single file are spread over the cores instead
+    QThreadPool serialPool;
+    serialPool.setMaxThreadCount(1);
+    QThreadPool *entryPool = files.count() > 1 ? &serialPool : &filePool;
+
+    Tracing::enableFromEnvironment();
+    if (parser.isSet(traceOption))
+        Tracing::setEnabled(true);
+
+    const Command selectedCommand = command.value();
+    QtConcurrent::blockingMap(&filePool, files, [&](const QString &meshFile) {
+        processFile(selectedCommand, meshFile, entryPool);
+    });
+
+    Tracing::writeTraceFromEnvironment();
+    if (parser.isSet(traceOption))
+        Tracing::writeChromeTrace(parser.value(traceOption));
+
+    return m_failures > 0 ? 1 : 0;
+}
+
+void MeshViewerCli::processFile(Command command, const QString &meshFile, QThreadPool *entryPool)
+{
+    switch (command) {
+    case Info:
+        writeLine(info(meshFile));
+        break;
+    case Validate:
+        writeLine(validate(meshFile, entryPool));
+        break;
+    case Dump:
+        dump(meshFile, entryPool);
+        break;
+    case Bench:
+        writeLine(bench(meshFile, entryPool));
+        break;
+    }
+}
+
+QJsonObject MeshViewerCli::info(const QString &meshFile)
+{
+    QJsonObject result {
+        { u"command"_qs, u"info"_qs },
+        { u"file"_qs, meshFile }
+    };
+
+    MeshFileTool meshFileTool;
+    const QVector<MeshSummary> summaries = meshFileTool.statMeshFile(meshFile);
+    if (summaries.isEmpty()) {
+        result.insert(u"error"_qs, u"not a valid mesh file"_qs);
+        ++m_failures;
+        return result;
+    }
+
+    QJsonArray meshes;
+    for (const MeshSummary &summary : summaries) {
+        QJsonArray attributes;
+        for (int i = 0; i < summary.vertexLayout.count(); ++i) {
+            const Mesh::VertexAttribute &attribute = summary.vertexLayout.at(i);
+            attributes.append(QJsonObject {
+                { u"name"_qs, QString::fromUtf8(summary.attributeNames.at(i).constData()) },
+                { u"componentType"_qs, componentTypeName(attribute.componentType) },
+                { u"components"_qs, qint64(attribute.numComponents) },
+                { u"offset"_qs, qint64(attribute.offset) }
+            });
+        }
+        QJsonArray subsets;
+        for (const MeshSummary::SubsetSummary &subset : summary.subsets) {
+            subsets.append(QJsonObject {
+                { u"name"_qs, subset.name },
+                { u"count"_qs, qint64(subset.count) },
+                { u"offset"_qs, qint64(subset.offset) },
+                { u"bounds"_qs, toJson(subset.bounds) }
+            });
+        }
+        meshes.append(QJsonObject {
+            { u"id"_qs, qint64(summary.id) },
+            { u"offset"_qs, qint64(summary.offset) },
+            { u"version"_qs, summary.fileVersion },
+            { u"sizeInBytes"_qs, qint64(summary.sizeInBytes) },
+            { u"stride"_qs, qint64(summary.stride) },
+            { u"vertexCount"_qs, qint64(summary.vertexCount()) },
+            { u"indexCount"_qs, qint64(summary.indexCount()) },
+            { u"indexType"_qs, componentTypeName(summary.indexComponentType) },
+            { u"drawMode"_qs, drawModeName(summary.drawMode) },
+            { u"windingMode"_qs, windingModeName(summary.windingMode) },
+            { u"attributes"_qs, attributes },
+            { u"subsets"_qs, subsets },
+            { u"joints"_qs, qint64(summary.jointCount) }
+        });
+    }
+    result.insert(u"meshes"_qs, meshes);
+    return result;
+}
+
+QJsonObject MeshViewerCli::validate(const QString &meshFile, QThreadPool *entryPool)
+{
+    QJsonObject result {
+        { u"command"_qs, u"validate"_qs },
+        { u"file"_qs, meshFile }
+    };
+
+    MeshFileTool meshFileTool;
+    meshFileTool.setThreadPool(entryPool);
+    const QVector<Mesh *> meshes = meshFileTool.loadMeshFile(meshFile, MeshFileTool::Mapped);
+
+    QJsonArray errors;
+    if (meshes.isEmpty())
+        errors.append(u"not a valid mesh file"_qs);
+    for (const Mesh *mesh : meshes) {
+        const QStringList meshErrors = mesh->validate();
+        for (const QString &error : meshErrors)
+            errors.append(QStringLiteral("mesh %1: %2").arg(mesh->meshId()).arg(error));
+    }
+
+    // Whether saving reproduces every entry, files written by other tools
+    // may lay their entries out differently so this alone is not an error
+    if (!meshes.isEmpty()) {
+        const bool roundTrip = std::all_of(meshes.cbegin(), meshes.cend(), [](const Mesh *mesh) {
+            return mesh->roundTrips();
+        });
+        result.insert(u"roundTrip"_qs, roundTrip);
+    }
+    qDeleteAll(meshes);
+
+    result.insert(u"valid"_qs, errors.isEmpty());
+    result.insert(u"errors"_qs, errors);
+    if (!errors.isEmpty())
+        ++m_failures;
+    return result;
+}
+
+void MeshViewerCli::dump(const QString &meshFile, QThreadPool *entryPool)
+{
+    MeshFileTool meshFileTool;
+    meshFileTool.setThreadPool(entryPool);
+    const QVector<Mesh *> meshes = meshFileTool.loadMeshFile(meshFile, MeshFileTool::Mapped);
+    if (meshes.isEmpty()) {
+        writeLine({
+            { u"command"_qs, u"dump"_qs },
+            { u"file"_qs, meshFile },
+            { u"error"_qs, u"not a valid mesh file"_qs }
+        });
+        ++m_failures;
+        return;
+    }
+
+    // One line per subset, only the attributes present in the mesh are written
+    for (const Mesh *mesh : meshes) {
+        const QVector<Mesh::Subset *> subsets = mesh->subsets();
+        for (int i = 0; i < subsets.count(); ++i) {
+            const Mesh::Subset *subset = subsets.at(i);
+            QJsonObject attributes;
+            auto addAttribute = [&](const QString &name, const auto &values, int components) {
+                if (!values.isEmpty())
+                    attributes.insert(name, toJson(values, components, m_dumpLimit));
+            };
+            auto addChannels = [&](const QString &name, const auto &channels, int components) {
+                for (auto it = channels.cbegin(); it != channels.cend(); ++it)
+                    addAttribute(name + QString::number(it.key()), it.value(), components);
+            };
+            addAttribute(u"position"_qs, subset->positions(), 3);
+            addAttribute(u"normal"_qs, subset->normals(), 3);
+            addChannels(u"uv"_qs, subset->uvs(), 2);
+            addAttribute(u"tangent"_qs, subset->tangents(), 3);
+            addAttribute(u"binormal"_qs, subset->binormals(), 3);
+            addAttribute(u"color"_qs, subset->colors(), 4);
+            addAttribute(u"joints"_qs, subset->joints(), 4);
+            addAttribute(u"weights"_qs, subset->weights(), 4);
+            addChannels(u"morphPosition"_qs, subset->morphTargetPositions(), 3);
+            addChannels(u"morphNormal"_qs, subset->morphTargetNormals(), 3);
+            addChannels(u"morphTangent"_qs, subset->morphTargetTangents(), 3);
+            addChannels(u"morphBinormal"_qs, subset->morphTargetBinormals(), 3);
+
+            writeLine({
+                { u"command"_qs, u"dump"_qs },
+                { u"file"_qs, meshFile },
+                { u"mesh"_qs, qint64(mesh->meshId()) },
+                { u"subset"_qs, i },
+                { u"name"_qs, subset->name() },
+                { u"count"_qs, subset->count() },
+                { u"drawMode"_qs, drawModeName(subset->drawMode()) },
+                { u"windingMode"_qs, windingModeName(subset->windingMode()) },
+                { u"bounds"_qs, toJson(subset->bounds()) },
+                { u"attributes"_qs, attributes }
+            });
+        }
+    }
+    qDeleteAll(meshes);
+}
+
+QJsonObject MeshViewerCli::bench(const QString &meshFile, QThreadPool *entryPool)
+{
+    QJsonObject result {
+        { u"command"_qs, u"bench"_qs },
+        { u"file"_qs, meshFile }
+    };
+
+    MeshFileTool meshFileTool;
+    meshFileTool.setThreadPool(entryPool);
+    const qint64 fileSize = QFileInfo(meshFile).size();
+
+    // The fastest of the runs is reported, the later ones see a warm page cache
+    qint64 statTime = std::numeric_limits<qint64>::max();
+    qint64 streamedTime = std::numeric_limits<qint64>::max();
+    qint64 mappedTime = std::numeric_limits<qint64>::max();
+    qint64 decodeTime = std::numeric_limits<qint64>::max();
+    quint64 vertexCount = 0;
+    qsizetype meshCount = 0;
+    QElapsedTimer timer;
+    for (int i = 0; i < m_benchIterations; ++i) {
+        timer.start();
+        const QVector<MeshSummary> summaries = meshFileTool.statMeshFile(meshFile);
+        statTime = qMin(statTime, timer.nsecsElapsed());
+        if (summaries.isEmpty()) {
+            result.insert(u"error"_qs, u"not a valid mesh file"_qs);
+            ++m_failures;
+            return result;
+        }
+
+        timer.start();
+        QVector<Mesh *> meshes = meshFileTool.loadMeshFile(meshFile, MeshFileTool::Streamed);
+        streamedTime = qMin(streamedTime, timer.nsecsElapsed());
+        qDeleteAll(meshes);
+
+        timer.start();
+        meshes = meshFileTool.loadMeshFile(meshFile, MeshFileTool::Mapped);
+        mappedTime = qMin(mappedTime, timer.nsecsElapsed());
+
+        timer.start();
+        vertexCount = 0;
+        for (const Mesh *mesh : std::as_const(meshes)) {
+            const QVector<Mesh::Subset *> subsets = mesh->subsets();
+            for (const Mesh::Subset *subset : subsets)
+                vertexCount += decodeSubset(subset);
+        }
+        decodeTime = qMin(decodeTime, timer.nsecsElapsed());
+        meshCount = meshes.count();
+        qDeleteAll(meshes);
+    }
+
+    const double megabytes = fileSize / (1024.0 * 1024.0);
+    result.insert(u"bytes"_qs, fileSize);
+    result.insert(u"meshes"_qs, meshCount);
+    result.insert(u"vertices"_qs, qint64(vertexCount));
+    result.insert(u"iterations"_qs, m_benchIterations);
+    result.insert(u"statMs"_qs, toMilliseconds(statTime));
+    result.insert(u"loadStreamedMs"_qs, toMilliseconds(streamedTime));
+    result.insert(u"loadMappedMs"_qs, toMilliseconds(mappedTime));
+    result.insert(u"decodeMs"_qs, toMilliseconds(decodeTime));
+    result.insert(u"loadStreamedMBps"_qs, perSecond(megabytes, streamedTime));
+    result.insert(u"loadMappedMBps"_qs, perSecond(megabytes, mappedTime));
+    result.insert(u"decodeVerticesPerSecond"_qs, perSecond(vertexCount, decodeTime));
+    return result;
+}
+
+void MeshViewerCli::writeLine(const QJsonObject &line)
+{
+    const QByteArray json = QJsonDocument(line).toJson(QJsonDocument::Compact);
+    QMutexLocker locker(&m_outputMutex);
+    fwrite(json.constData(), 1, json.size(), stdout);
+    fputc('\n', stdout);
+    fflush(stdout);
+}
+
+QStringList MeshViewerCli::collectFiles(const QStringList &paths, QStringList *missing)
+{
+    QStringList files;
+    for (const QString &path : paths) {
+        const QFileInfo fileInfo(path);
+        if (fileInfo.isDir()) {
+            QStringList directoryFiles;
+            QDirIterator it(path, { u"*.mesh"_qs }, QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext())
+                directoryFiles.append(it.next());
+            directoryFiles.sort();
+            files.append(directoryFiles);
+        } else if (fileInfo.exists()) {
+            files.append(path);
+        } else {
+            missing->append(path);
+        }
+    }
+    return files;
+}
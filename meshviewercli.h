@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2023 Andy Nichols <nezticle@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MESHVIEWERCLI_H
+#define MESHVIEWERCLI_H
+
+#include <QJsonObject>
+#include <QMutex>
+#include <QStringList>
+
+#include <atomic>
+
+class QThreadPool;
+
+// Headless batch inspection of .mesh files, every result is written to
+// stdout as one line of JSON
+class MeshViewerCli
+{
+public:
+    int run(const QStringList &arguments);
+
+private:
+    enum Command {
+        Info,
+        Validate,
+        Dump,
+        Bench
+    };
+
+    void processFile(Command command, const QString &meshFile, QThreadPool *entryPool);
+    QJsonObject info(const QString &meshFile);
+    QJsonObject validate(const QString &meshFile, QThreadPool *entryPool);
+    void dump(const QString &meshFile, QThreadPool *entryPool);
+    QJsonObject bench(const QString &meshFile, QThreadPool *entryPool);
+
+    void writeLine(const QJsonObject &line);
+    static QStringList collectFiles(const QStringList &paths, QStringList *missing);
+
+    QMutex m_outputMutex;
+    std::atomic<int> m_failures = 0;
+    int m_dumpLimit = -1;
+    int m_benchIterations = 3;
+};
+
+#endif // MESHVIEWERCLI_H
@@ -0,0 +1,476 @@
+/*
+ * Copyright (c) 2023 Andy Nichols <nezticle@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+
+#include <QtTest>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QThreadPool>
+#include <QtCore/qfloat16.h>
+
+#include "attributedecoder.h"
+#include "geometrygenerator.h"
+#include "glyphtexture.h"
+#include "mesh.h"
+#include "syntheticmesh.h"
+
+// Correctness checks of the loader and decoders on synthetic data, the
+// timings are in MeshViewerBenchmarks
+class MeshViewerTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void parallelLoadMatchesSerial_data();
+    void parallelLoadMatchesSerial();
+    void decodeMatchesReference_data();
+    void decodeMatchesReference();
+    void saveRoundTrip_data();
+    void saveRoundTrip();
+    void subsetHashFollowsItsVertexes();
+    void glyphDirectionRoundTrip_data();
+    void glyphDirectionRoundTrip();
+    void glyphRandomDirections();
+    void glyphRecords();
+    void normalGlyphsFollowNormals();
+
+private:
+    QTemporaryDir m_directory;
+    QString m_multiMeshFile;
+};
+
+void MeshViewerTests::initTestCase()
+{
+    QVERIFY(m_directory.isValid());
+
+    // Entries of different sizes, so a mix up between them shows
+    QVector<Mesh *> meshes;
+    for (quint32 vertexCount : { 1024u, 4096u, 300u, 16384u, 2048u }) {
+        SyntheticMesh::Options options;
+        options.vertexCount = vertexCount;
+        options.subsetCount = 3;
+        options.colors = true;
+        meshes.append(SyntheticMesh::create(options));
+    }
+    m_multiMeshFile = m_directory.filePath(QStringLiteral("multi.mesh"));
+    MeshFileTool meshFileTool;
+    const bool saved = meshFileTool.saveMeshFile(m_multiMeshFile, meshes);
+    qDeleteAll(meshes);
+    QVERIFY(saved);
+}
+
+void MeshViewerTests::parallelLoadMatchesSerial_data()
+{
+    QTest::addColumn<int>("loadMode");
+    QTest::newRow("mapped") << int(MeshFileTool::Mapped);
+    QTest::newRow("streamed") << int(MeshFileTool::Streamed);
+}
+
+void MeshViewerTests::parallelLoadMatchesSerial()
+{
+    QFETCH(int, loadMode);
+
+    QThreadPool serialPool;
+    serialPool.setMaxThreadCount(1);
+    MeshFileTool serialTool;
+    serialTool.setThreadPool(&serialPool);
+    const QVector<Mesh *> serial = serialTool.loadMeshFile(m_multiMeshFile, MeshFileTool::LoadMode(loadMode));
+
+    QThreadPool parallelPool;
+    parallelPool.setMaxThreadCount(qMax(4, QThread::idealThreadCount()));
+    MeshFileTool parallelTool;
+    parallelTool.setThreadPool(&parallelPool);
+    const QVector<Mesh *> parallel = parallelTool.loadMeshFile(m_multiMeshFile, MeshFileTool::LoadMode(loadMode));
+
+    QCOMPARE(serial.count(), 5);
+    QCOMPARE(parallel.count(), serial.count());
+    for (int i = 0; i < serial.count(); ++i) {
+        const Mesh *a = serial.at(i);
+        const Mesh *b = parallel.at(i);
+        QCOMPARE(b->meshId(), a->meshId());
+        // Entries come back ordered by id
+        if (i > 0)
+            QVERIFY(a->meshId() > serial.at(i - 1)->meshId());
+        QCOMPARE(b->subsets().count(), a->subsets().count());
+        QCOMPARE(b->contentHash(), a->contentHash());
+        for (int j = 0; j < a->subsets().count(); ++j) {
+            QCOMPARE(b->subsets().at(j)->name(), a->subsets().at(j)->name());
+            QCOMPARE(b->subsets().at(j)->positions(), a->subsets().at(j)->positions());
+        }
+    }
+    qDeleteAll(serial);
+    qDeleteAll(parallel);
+}
+
+void MeshViewerTests::decodeMatchesReference_data()
+{
+    QTest::addColumn<int>("componentType");
+    QTest::addColumn<int>("numComponents");
+    QTest::addColumn<bool>("normalized");
+
+    static const char *typeNames[] = { "u8", "i8", "u16", "i16", "u32", "i32", "u64", "i64", "f16", "f32", "f64" };
+    for (int type = Mesh::UnsignedInt8; type <= Mesh::Float64; ++type) {
+        for (int numComponents = 1; numComponents <= 4; ++numComponents) {
+            for (bool normalized : { false, true }) {
+                const QString tag = QStringLiteral("%1x%2%3").arg(QLatin1String(typeNames[type - 1]))
+                        .arg(numComponents).arg(normalized ? QStringLiteral("-normalized") : QString());
+                QTest::newRow(qPrintable(tag)) << type << numComponents << normalized;
+            }
+        }
+    }
+}
+
+void MeshViewerTests::decodeMatchesReference()
+{
+    QFETCH(int, componentType);
+    QFETCH(int, numComponents);
+    QFETCH(bool, normalized);
+
+    // Interleaved with other data and an odd stride, so the attribute is
+    // unaligned, the last vertex ends right at the end of the buffer
+    const auto type = Mesh::ComponentType(componentType);
+    const int componentSize = AttributeDecoder::componentSize(type);
+    const quint32 offset = 3;
+    const quint32 stride = offset + componentSize * numComponents + 5;
+    const quint32 vertexCount = 997;
+    QByteArray data((vertexCount - 1) * stride + offset + componentSize * numComponents, Qt::Uninitialized);
+
+    QRandomGenerator random(componentType * 10 + numComponents);
+    for (qsizetype i = 0; i < data.size(); ++i)
+        data[i] = char(random.bounded(256));
+    // Random bytes would be NaNs and infinities as often as not
+    for (quint32 vertex = 0; vertex < vertexCount; ++vertex) {
+        char *p = data.data() + vertex * stride + offset;
+        for (int c = 0; c < numComponents; ++c, p += componentSize) {
+            const double value = random.bounded(2000.0) - 1000.0;
+            if (type == Mesh::Float16) {
+                const qfloat16 half(float(value) / 16.0f);
+                memcpy(p, &half, sizeof(half));
+            } else if (type == Mesh::Float32) {
+                const float single(value);
+                memcpy(p, &single, sizeof(single));
+            } else if (type == Mesh::Float64) {
+                memcpy(p, &value, sizeof(value));
+            }
+        }
+    }
+
+    // Every vertex, in order and shuffled, and indexes past the end
+    QVector<quint32> indexes;
+    for (quint32 i = 0; i < vertexCount; ++i)
+        indexes.append(i);
+    for (quint32 i = 0; i < 2 * vertexCount; ++i)
+        indexes.append(random.bounded(vertexCount));
+    indexes << vertexCount << vertexCount + 1 << 0xffffffffu << vertexCount - 1;
+
+    AttributeDecoder::Source source;
+    source.data = data.constData();
+    source.size = data.size();
+    source.stride = stride;
+    source.offset = offset;
+    source.componentType = type;
+    source.numComponents = numComponents;
+    source.normalized = normalized;
+
+    // The kernels that are compiled in, SSE2 on x86 and AVX2 with
+    // MESHVIEWER_ENABLE_AVX2, against the plain per component decoder
+    for (int outComponents = 1; outComponents <= 4; ++outComponents) {
+        QVector<float> decoded(indexes.count() * outComponents, -42.0f);
+        QVector<float> reference(indexes.count() * outComponents, 42.0f);
+        QVERIFY(AttributeDecoder::decode(source, indexes.constData(), indexes.count(), decoded.data(), outComponents));
+        QVERIFY(AttributeDecoder::decodeReference(source, indexes.constData(), indexes.count(),
+                                                  reference.data(), outComponents));
+        for (int i = 0; i < decoded.count(); ++i) {
+            const float a = decoded.at(i);
+            const float b = reference.at(i);
+            if (a != b && qAbs(a - b) > qAbs(b) * 1e-6f)
+                QFAIL(qPrintable(QStringLiteral("%1 output components: value %2 of vertex index %3 is %4, expected %5")
+                                 .arg(outComponents).arg(i % outComponents).arg(indexes.at(i / outComponents))
+                                 .arg(a).arg(b)));
+        }
+    }
+}
+
+void MeshViewerTests::saveRoundTrip_data()
+{
+    QTest::addColumn<int>("loadMode");
+    QTest::addColumn<int>("options");
+
+    // options indexes the layouts below, -1 saves the multi mesh file again
+    QTest::newRow("multi-mapped") << int(MeshFileTool::Mapped) << -1;
+    QTest::newRow("multi-streamed") << int(MeshFileTool::Streamed) << -1;
+    static const char *layouts[] = { "default", "index16-odd", "joints", "morph-targets", "bare" };
+    for (int i = 0; i < 5; ++i) {
+        QTest::newRow(qPrintable(QStringLiteral("%1-mapped").arg(QLatin1String(layouts[i])))) << int(MeshFileTool::Mapped) << i;
+        QTest::newRow(qPrintable(QStringLiteral("%1-streamed").arg(QLatin1String(layouts[i])))) << int(MeshFileTool::Streamed) << i;
+    }
+}
+
+void MeshViewerTests::saveRoundTrip()
+{
+    QFETCH(int, loadMode);
+    QFETCH(int, options);
+
+    QString sourceFile = m_multiMeshFile;
+    if (options >= 0) {
+        SyntheticMesh::Options layout;
+        layout.subsetCount = 2;
+        switch (options) {
+        case 1:
+            layout.vertexCount = 1001;
+            layout.indexType = Mesh::UnsignedInt16;
+            layout.uvChannels = 2;
+            break;
+        case 2:
+            layout.jointCount = 5;
+            layout.colors = true;
+            break;
+        case 3:
+            layout.morphTargets = 3;
+            break;
+        case 4:
+            layout.vertexCount = 7;
+            layout.subsetCount = 1;
+            layout.normals = false;
+            layout.tangents = false;
+            layout.uvChannels = 0;
+            break;
+        }
+        QScopedPointer<Mesh> mesh(SyntheticMesh::create(layout));
+        sourceFile = m_directory.filePath(QStringLiteral("source-%1.mesh").arg(QLatin1String(QTest::currentDataTag())));
+        QVERIFY(MeshFileTool().saveMeshFile(sourceFile, { mesh.data() }));
+    }
+
+    const QString savedFile = m_directory.filePath(QStringLiteral("saved-%1.mesh").arg(QLatin1String(QTest::currentDataTag())));
+    {
+        MeshFileTool meshFileTool;
+        const QVector<Mesh *> meshes = meshFileTool.loadMeshFile(sourceFile, MeshFileTool::LoadMode(loadMode));
+        QVERIFY(!meshes.isEmpty());
+        // Checked against the mapping, streamed meshes have none
+        for (const Mesh *mesh : meshes)
+            QCOMPARE(mesh->roundTrips(), loadMode == MeshFileTool::Mapped);
+        const bool saved = meshFileTool.saveMeshFile(savedFile, meshes);
+        qDeleteAll(meshes);
+        QVERIFY(saved);
+    }
+
+    QFile source(sourceFile);
+    QFile saved(savedFile);
+    QVERIFY(source.open(QIODevice::ReadOnly));
+    QVERIFY(saved.open(QIODevice::ReadOnly));
+    const QByteArray sourceBytes = source.readAll();
+    const QByteArray savedBytes = saved.readAll();
+    QCOMPARE(savedBytes.size(), sourceBytes.size());
+    if (savedBytes != sourceBytes) {
+        qsizetype i = 0;
+        while (savedBytes.at(i) == sourceBytes.at(i))
+            ++i;
+        QFAIL(qPrintable(QStringLiteral("Files differ at byte %1").arg(i)));
+    }
+}
+
+void MeshViewerTests::subsetHashFollowsItsVertexes()
+{
+    // The grid rows are split between the subsets, so the last vertex is
+    // only used by the last one
+    SyntheticMesh::Options options;
+    options.subsetCount = 4;
+    QScopedPointer<Mesh> mesh(SyntheticMesh::create(options));
+    const QString sourceFile = m_directory.filePath(QStringLiteral("hash-source.mesh"));
+    QVERIFY(MeshFileTool().saveMeshFile(sourceFile, { mesh.data() }));
+
+    QFile source(sourceFile);
+    QVERIFY(source.open(QIODevice::ReadOnly));
+    QByteArray bytes = source.readAll();
+    source.close();
+
+    MeshFileTool meshFileTool;
+    const QVector<Mesh *> before = meshFileTool.loadMeshFile(sourceFile, MeshFileTool::Streamed);
+    QCOMPARE(before.count(), 1);
+    const QVector<Mesh::Subset *> beforeSubsets = before.first()->subsets();
+    QCOMPARE(beforeSubsets.count(), 4);
+    const QVector3D position = beforeSubsets.last()->positions().last();
+    const QByteArray pattern(reinterpret_cast<const char *>(&position), sizeof(position));
+    // The vertex buffer comes before the subset bounds in the file
+    const qsizetype offset = bytes.indexOf(pattern);
+    QVERIFY(offset >= 0);
+    // The lowest bit of x
+    bytes[offset] = char(bytes.at(offset) ^ 1);
+
+    const QString editedFile = m_directory.filePath(QStringLiteral("hash-edited.mesh"));
+    QFile edited(editedFile);
+    QVERIFY(edited.open(QIODevice::WriteOnly));
+    QCOMPARE(edited.write(bytes), bytes.size());
+    edited.close();
+
+    const QVector<Mesh *> after = meshFileTool.loadMeshFile(editedFile, MeshFileTool::Streamed);
+    QCOMPARE(after.count(), 1);
+    const QVector<Mesh::Subset *> afterSubsets = after.first()->subsets();
+    QCOMPARE(afterSubsets.count(), 4);
+    QVERIFY(after.first()->contentHash() != before.first()->contentHash());
+    QCOMPARE(afterSubsets.first()->contentHash(), beforeSubsets.first()->contentHash());
+    QVERIFY(afterSubsets.last()->contentHash() != beforeSubsets.last()->contentHash());
+    qDeleteAll(before);
+    qDeleteAll(after);
+}
+
+void MeshViewerTests::glyphDirectionRoundTrip_data()
+{
+    QTest::addColumn<QVector3D>("direction");
+    // Axes decode exactly, the others within the 12 bit precision
+    QTest::addColumn<bool>("exact");
+
+    QTest::newRow("+x") << QVector3D(1.0f, 0.0f, 0.0f) << true;
+    QTest::newRow("-x") << QVector3D(-1.0f, 0.0f, 0.0f) << true;
+    QTest::newRow("+y") << QVector3D(0.0f, 1.0f, 0.0f) << true;
+    QTest::newRow("-y") << QVector3D(0.0f, -1.0f, 0.0f) << true;
+    QTest::newRow("+z") << QVector3D(0.0f, 0.0f, 1.0f) << true;
+    QTest::newRow("-z") << QVector3D(0.0f, 0.0f, -1.0f) << true;
+    QTest::newRow("+z-unnormalized") << QVector3D(0.0f, 0.0f, 42.0f) << true;
+    QTest::newRow("diagonal") << QVector3D(1.0f, 1.0f, 1.0f) << false;
+    QTest::newRow("-z-diagonal") << QVector3D(1.0f, 1.0f, -1.0f) << false;
+    QTest::newRow("-z-quadrant-2") << QVector3D(-1.0f, 0.5f, -2.0f) << false;
+    QTest::newRow("-z-quadrant-3") << QVector3D(-0.3f, -0.7f, -0.1f) << false;
+    QTest::newRow("-z-quadrant-4") << QVector3D(0.6f, -0.2f, -0.9f) << false;
+    QTest::newRow("-z-grazing") << QVector3D(0.7f, -0.7f, -1e-4f) << false;
+    QTest::newRow("-z-near-pole") << QVector3D(1e-3f, -1e-3f, -1.0f) << false;
+}
+
+void MeshViewerTests::glyphDirectionRoundTrip()
+{
+    QFETCH(QVector3D, direction);
+    QFETCH(bool, exact);
+
+    // An integer below 2^24, which the texture and shader keep exactly
+    const float packed = GlyphTexture::packDirection(direction);
+    QVERIFY(packed >= 0.0f);
+    QVERIFY(packed < 16777216.0f);
+    QCOMPARE(float(quint32(packed)), packed);
+    // The lower hemisphere is folded outside the |x| + |y| <= 1 diamond
+    const int x = int(quint32(packed) >> 12) - 2047;
+    const int y = int(quint32(packed) & 0xfff) - 2047;
+    if (direction.z() < 0.0f)
+        QVERIFY(qAbs(x) + qAbs(y) >= 2047);
+
+    const QVector3D decoded = GlyphTexture::unpackDirection(packed);
+    const QVector3D expected = direction.normalized();
+    if (exact)
+        QCOMPARE(decoded, expected);
+    else
+        QVERIFY2((decoded - expected).length() < 1.5e-3f, qPrintable(QStringLiteral("decoded to %1 %2 %3")
+                 .arg(decoded.x()).arg(decoded.y()).arg(decoded.z())));
+    QVERIFY(qAbs(decoded.length() - 1.0f) < 1e-5f);
+}
+
+void MeshViewerTests::glyphRandomDirections()
+{
+    const float zero = GlyphTexture::packDirection(QVector3D());
+    QCOMPARE(zero, -1.0f);
+    QVERIFY(GlyphTexture::unpackDirection(zero).isNull());
+
+    QRandomGenerator random(1);
+    for (int i = 0; i < 100000; ++i) {
+        QVector3D direction;
+        while (direction.lengthSquared() < 1e-6f) {
+            direction = QVector3D(float(random.generateDouble() * 2.0 - 1.0),
+                                  float(random.generateDouble() * 2.0 - 1.0),
+                                  float(random.generateDouble() * 2.0 - 1.0));
+        }
+        const float packed = GlyphTexture::packDirection(direction);
+        QVERIFY(packed >= 0.0f);
+        const QVector3D decoded = GlyphTexture::unpackDirection(packed);
+        if ((decoded - direction.normalized()).length() >= 1.5e-3f) {
+            QFAIL(qPrintable(QStringLiteral("%1 %2 %3 decoded to %4 %5 %6")
+                             .arg(direction.x()).arg(direction.y()).arg(direction.z())
+                             .arg(decoded.x()).arg(decoded.y()).arg(decoded.z())));
+        }
+    }
+}
+
+void MeshViewerTests::glyphRecords()
+{
+    // One texel of the RGBA32F texture per record
+    QCOMPARE(sizeof(GlyphTexture::Record), size_t(16));
+    QCOMPARE(GlyphTexture::paddedSize(0), qsizetype(0));
+    QCOMPARE(GlyphTexture::paddedSize(1), qsizetype(GlyphTexture::rowLength * 16));
+    QCOMPARE(GlyphTexture::paddedSize(GlyphTexture::rowLength), qsizetype(GlyphTexture::rowLength * 16));
+    QCOMPARE(GlyphTexture::paddedSize(GlyphTexture::rowLength + 1), qsizetype(2 * GlyphTexture::rowLength * 16));
+
+    const QVector<QPair<QVector3D, QVector3D>> glyphs = {
+        { QVector3D(0.0f, 0.0f, 0.0f), QVector3D(0.0f, 1.0f, 0.0f) },
+        { QVector3D(1.0f, 2.0f, 3.0f), QVector3D(0.0f, -1.0f, 0.0f) },
+        { QVector3D(-4.0f, 0.5f, 2.0f), QVector3D(1.0f, 0.0f, 0.0f) },
+        { QVector3D(10.0f, -10.0f, 0.25f), QVector3D(0.0f, 0.0f, -3.0f) },
+        { QVector3D(0.1f, 0.2f, 0.3f), QVector3D(-0.3f, 0.5f, -0.8f) },
+        { QVector3D(7.0f, 8.0f, 9.0f), QVector3D() },
+    };
+    QByteArray records(GlyphTexture::paddedSize(glyphs.count()), Qt::Uninitialized);
+    GlyphTexture::fillPadding(&records, glyphs.count());
+    auto record = reinterpret_cast<GlyphTexture::Record *>(records.data());
+    for (int i = 0; i < glyphs.count(); ++i)
+        record[i] = GlyphTexture::makeRecord(glyphs.at(i).first, glyphs.at(i).second);
+
+    for (int i = 0; i < glyphs.count(); ++i) {
+        QCOMPARE(QVector3D(record[i].position[0], record[i].position[1], record[i].position[2]), glyphs.at(i).first);
+        const QVector3D direction = GlyphTexture::decodeDirection(record[i]);
+        QVERIFY((direction - glyphs.at(i).second.normalized()).length() < 1.5e-3f);
+    }
+    // The padding is not drawn
+    for (int i = glyphs.count(); i < GlyphTexture::rowLength; ++i)
+        QVERIFY(record[i].direction < 0.0f);
+}
+
+void MeshViewerTests::normalGlyphsFollowNormals()
+{
+    SyntheticMesh::Options options;
+    options.vertexCount = 1024;
+    QScopedPointer<Mesh> mesh(SyntheticMesh::create(options));
+    const GeometryGenerator::SubsetData data = GeometryGenerator::subsetData(mesh->subsets().first(), false);
+    const QByteArray records = GeometryGenerator::generateGeometry(GeometryGenerator::NormalGeometry, data).vertexData;
+
+    // The face normal and the three vertex normals of every triangle
+    const int triangles = data.count / 3;
+    QVERIFY(triangles > 0);
+    QCOMPARE(records.size(), GlyphTexture::paddedSize(triangles * 4));
+    auto glyph = reinterpret_cast<const GlyphTexture::Record *>(records.constData());
+    for (int i = 0; i < triangles; ++i) {
+        const QVector3D &a = data.positions.at(i * 3);
+        const QVector3D &b = data.positions.at(i * 3 + 1);
+        const QVector3D &c = data.positions.at(i * 3 + 2);
+        const QVector3D faceNormal = QVector3D::crossProduct(b - a, c - a).normalized();
+        QVERIFY(QVector3D::dotProduct(GlyphTexture::decodeDirection(*glyph++), faceNormal) > 0.9999f);
+        for (int j = 0; j < 3; ++j, ++glyph) {
+            const int vertex = i * 3 + j;
+            QCOMPARE(QVector3D(glyph->position[0], glyph->position[1], glyph->position[2]), data.positions.at(vertex));
+            const QVector3D normal = data.normals.at(vertex).normalized();
+            QVERIFY(QVector3D::dotProduct(GlyphTexture::decodeDirection(*glyph), normal) > 0.9999f);
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(MeshViewerTests)
+
+#include "meshviewertests.moc"
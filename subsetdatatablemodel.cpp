@@ -25,6 +25,7 @@
  */
 
 #include "subsetdatatablemodel.h"
+#include "tracing.h"
 
 SubsetDataTableModel::SubsetDataTableModel()
 {
@@ -41,6 +42,7 @@ void SubsetDataTableModel::setMesh(Mesh *mesh)
     if (m_mesh == mesh)
         return;
 
+    TraceSpan span("data table model reset");
     beginResetModel();
     m_mesh = mesh;
     emit meshChanged(m_mesh);
@@ -53,6 +55,7 @@ void SubsetDataTableModel::setSubsetIndex(int subsetIndex)
     if (m_subsetIndex == subsetIndex)
         return;
 
+    TraceSpan span("data table model reset");
     beginResetModel();
     m_subsetIndex = subsetIndex;
     emit subsetIndexChanged(m_subsetIndex);
@@ -60,6 +63,14 @@ void SubsetDataTableModel::setSubsetIndex(int subsetIndex)
     endResetModel();
 }
 
+qint64 SubsetDataTableModel::cacheBytes() const
+{
+    qint64 bytes = 0;
+    for (const auto &field : m_fields)
+        bytes += sizeof(AttributeField) + field.headerName.size() * sizeof(QChar);
+    return bytes;
+}
+
 void SubsetDataTableModel::updateModelData()
 {
     m_fields.clear();
@@ -67,7 +78,7 @@ void SubsetDataTableModel::updateModelData()
         return;
 
     const auto &subsets = m_mesh->subsets();
-    if (m_subsetIndex > subsets.count())
+    if (m_subsetIndex >= subsets.count())
         return;
 
     const auto &subset = subsets[m_subsetIndex];
@@ -145,7 +156,7 @@ int SubsetDataTableModel::rowCount(const QModelIndex &parent) const
         return 0;
 
     const auto &subsets = m_mesh->subsets();
-    if (m_subsetIndex > subsets.count())
+    if (m_subsetIndex >= subsets.count())
         return 0;
 
     const auto &subset = subsets[m_subsetIndex];
@@ -189,7 +200,7 @@ QVariant SubsetDataTableModel::data(const QModelIndex &index, int role) const
     };
 
     const auto &subsets = m_mesh->subsets();
-    if (m_subsetIndex > subsets.count())
+    if (m_subsetIndex >= subsets.count())
         return 0;
 
     const auto &subset = subsets[m_subsetIndex];
@@ -260,7 +271,7 @@ QVector3D SubsetDataTableModel::vertexPositionAtRow(int row)
         return QVector3D();
 
     const auto &subsets = m_mesh->subsets();
-    if (m_subsetIndex > subsets.count())
+    if (m_subsetIndex >= subsets.count())
         return QVector3D();
 
     const auto &subset = subsets[m_subsetIndex];
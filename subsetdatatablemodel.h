@@ -51,6 +51,12 @@ public:
 
     Q_INVOKABLE QVector3D vertexPositionAtRow(int row);
 
+    // Bytes of the column description cached for the current subset
+    qint64 cacheBytes() const;
+    // Builds the column description of the current subset again, which
+    // setMesh() and setSubsetIndex() do
+    void updateModelData();
+
 public slots:
     void setMesh(Mesh* mesh);
     void setSubsetIndex(int subsetIndex);
@@ -85,7 +91,6 @@ private:
         {}
     };
 
-    void updateModelData();
     QVector<AttributeField> m_fields;
     Mesh *m_mesh = nullptr;
     int m_subsetIndex = 0;   
@@ -25,6 +25,7 @@
  */
 
 #include "subsetlistmodel.h"
+#include "tracing.h"
 
 SubsetListModel::SubsetListModel()
 {
@@ -41,12 +42,28 @@ void SubsetListModel::setMesh(Mesh *mesh)
     if (m_mesh == mesh)
         return;
 
+    TraceSpan span("subset list model reset");
     beginResetModel();
     m_mesh = mesh;
     emit meshChanged(m_mesh);
     endResetModel();
 }
 
+void SubsetListModel::updateMesh(Mesh *mesh)
+{
+    // A reset would move the view back to the first subset
+    if (!m_mesh || !mesh || m_mesh->subsets().count() != mesh->subsets().count()) {
+        setMesh(mesh);
+        return;
+    }
+
+    m_mesh = mesh;
+    emit meshChanged(m_mesh);
+    const int count = m_mesh->subsets().count();
+    if (count > 0)
+        emit dataChanged(index(0), index(count - 1));
+}
+
 int SubsetListModel::rowCount(const QModelIndex &parent) const
 {
     // For list models only the root node (an invalid parent) should return the list's size. For all
@@ -53,6 +53,8 @@ public:
 
 public slots:
     void setMesh(Mesh* mesh);
+    // Swaps in a reloaded mesh, without a reset when the subset count is the same
+    void updateMesh(Mesh* mesh);
 
 signals:
     void meshChanged(Mesh* mesh);
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2023 Andy Nichols <nezticle@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "syntheticmesh.h"
+
+#include <QtMath>
+
+#include <cstring>
+#include <limits>
+
+namespace {
+struct GridVertex {
+    QVector3D position;
+    QVector3D normal;
+    QVector3D tangent;
+    QVector3D binormal;
+    QVector2D uv;
+};
+
+// Height field over [-1, 1] x [-1, 1] with its analytic derivatives
+GridVertex gridVertex(float u, float v)
+{
+    static const float amplitude = 0.1f;
+    static const float frequency = 6.0f;
+    const float x = u * 2.0f - 1.0f;
+    const float z = v * 2.0f - 1.0f;
+    const float y = amplitude * qSin(frequency * x) * qCos(frequency * z);
+    const float dx = amplitude * frequency * qCos(frequency * x) * qCos(frequency * z);
+    const float dz = -amplitude * frequency * qSin(frequency * x) * qSin(frequency * z);
+
+    GridVertex vertex;
+    vertex.position = QVector3D(x, y, z);
+    vertex.tangent = QVector3D(1.0f, dx, 0.0f).normalized();
+    vertex.binormal = QVector3D(0.0f, dz, 1.0f).normalized();
+    vertex.normal = QVector3D::crossProduct(vertex.binormal, vertex.tangent).normalized();
+    vertex.uv = QVector2D(u, v);
+    return vertex;
+}
+}
+
+QVector<Mesh::VertexBufferEntry> SyntheticMesh::vertexLayout(const Options &options)
+{
+    QVector<Mesh::VertexBufferEntry> entries;
+    quint32 offset = 0;
+    auto addEntry = [&](const QByteArray &name, Mesh::ComponentType componentType, quint32 numComponents) {
+        Mesh::VertexBufferEntry entry;
+        entry.componentType = componentType;
+        entry.numComponents = numComponents;
+        entry.firstItemOffset = offset;
+        entry.name = name + '\0';
+        entries.append(entry);
+        offset += numComponents * 4;
+    };
+
+    // create() writes the vertexes in this order
+    addEntry("attr_pos", Mesh::Float32, 3);
+    if (options.normals)
+        addEntry("attr_norm", Mesh::Float32, 3);
+    for (int channel = 0; channel < options.uvChannels; ++channel)
+        addEntry("attr_uv" + QByteArray::number(channel), Mesh::Float32, 2);
+    if (options.tangents) {
+        addEntry("attr_textan", Mesh::Float32, 3);
+        addEntry("attr_binormal", Mesh::Float32, 3);
+    }
+    if (options.colors)
+        addEntry("attr_color", Mesh::Float32, 4);
+    if (options.jointCount > 0) {
+        addEntry("attr_joints", Mesh::Int32, 4);
+        addEntry("attr_weights", Mesh::Float32, 4);
+    }
+    for (int target = 0; target < options.morphTargets; ++target) {
+        const QByteArray index = QByteArray::number(target);
+        addEntry("attr_tpos" + index, Mesh::Float32, 3);
+        if (options.normals)
+            addEntry("attr_tnorm" + index, Mesh::Float32, 3);
+        if (options.tangents) {
+            addEntry("attr_ttan" + index, Mesh::Float32, 3);
+            addEntry("attr_tbinorm" + index, Mesh::Float32, 3);
+        }
+    }
+    return entries;
+}
+
+quint32 SyntheticMesh::stride(const Options &options)
+{
+    const auto entries = vertexLayout(options);
+    const auto &last = entries.last();
+    return last.firstItemOffset + last.numComponents * 4;
+}
+
+quint32 SyntheticMesh::bytesPerVertex(const Options &options)
+{
+    // Two triangles per grid vertex
+    const quint32 indexSize = options.indexType == Mesh::UnsignedInt16 ? 2 : 4;
+    return stride(options) + 6 * indexSize;
+}
+
+Mesh *SyntheticMesh::create(const Options &options)
+{
+    quint32 vertexCount = qMax(options.vertexCount, 4u);
+    if (options.indexType == Mesh::UnsignedInt16 && vertexCount > 65536) {
+        qWarning() << "16bit indexes address at most 65536 vertexes, the mesh is made smaller";
+        vertexCount = 65536;
+    }
+    // Sections sizes are stored as 32bit values
+    const quint32 maxVertexCount = std::numeric_limits<quint32>::max() / bytesPerVertex(options);
+    if (vertexCount > maxVertexCount) {
+        qWarning() << "A single mesh holds at most" << maxVertexCount << "vertexes of this layout, the mesh is made smaller";
+        vertexCount = maxVertexCount;
+    }
+    const quint32 columns = qMax(2u, quint32(qSqrt(vertexCount)));
+    const quint32 rows = qMax(2u, vertexCount / columns);
+    vertexCount = columns * rows;
+
+    auto mesh = new Mesh;
+    mesh->m_meshInfo.fileId = 3365961549;
+    mesh->m_meshInfo.fileVersion = 3;
+    mesh->m_drawMode = Mesh::Triangles;
+    mesh->m_windingMode = Mesh::CounterClockwise;
+
+    mesh->m_vertexBuffer.entires = vertexLayout(options);
+    const quint32 stride = SyntheticMesh::stride(options);
+    mesh->m_vertexBuffer.stride = stride;
+
+    // Vertex data, in the order of vertexLayout()
+    mesh->m_vertexBuffer.data.resize(qsizetype(vertexCount) * stride);
+    char *vertexData = mesh->m_vertexBuffer.data.data();
+    auto write = [&vertexData](auto vector, int components) {
+        for (int i = 0; i < components; ++i) {
+            const float value = vector[i];
+            memcpy(vertexData, &value, sizeof(float));
+            vertexData += sizeof(float);
+        }
+    };
+    for (quint32 row = 0; row < rows; ++row) {
+        const float v = float(row) / (rows - 1);
+        for (quint32 column = 0; column < columns; ++column) {
+            const float u = float(column) / (columns - 1);
+            const GridVertex vertex = gridVertex(u, v);
+            write(vertex.position, 3);
+            if (options.normals)
+                write(vertex.normal, 3);
+            for (int channel = 0; channel < options.uvChannels; ++channel)
+                write(vertex.uv * float(channel + 1), 2);
+            if (options.tangents) {
+                write(vertex.tangent, 3);
+                write(vertex.binormal, 3);
+            }
+            if (options.colors)
+                write(QVector4D(u, v, 1.0f - u, 1.0f), 4);
+            if (options.jointCount > 0) {
+                // Each row blends between two neighbouring joints
+                const float position = v * (options.jointCount - 1);
+                const qint32 joints[4] = { qint32(position), qMin(qint32(position) + 1, qint32(options.jointCount - 1)), 0, 0 };
+                memcpy(vertexData, joints, sizeof(joints));
+                vertexData += sizeof(joints);
+                const float blend = position - qint32(position);
+                write(QVector4D(1.0f - blend, blend, 0.0f, 0.0f), 4);
+            }
+            for (int target = 0; target < options.morphTargets; ++target) {
+                // Targets push the surface out along the normal
+                write(vertex.normal * (0.05f * (target + 1)), 3);
+                if (options.normals)
+                    write(QVector3D(), 3);
+                if (options.tangents) {
+                    write(QVector3D(), 3);
+                    write(QVector3D(), 3);
+                }
+            }
+        }
+    }
+
+    // Two triangles per grid cell
+    const quint32 indexCount = (columns - 1) * (rows - 1) * 6;
+    const bool wideIndexes = options.indexType != Mesh::UnsignedInt16;
+    mesh->m_indexBuffer.componentType = wideIndexes ? Mesh::UnsignedInt32 : Mesh::UnsignedInt16;
+    mesh->m_indexBuffer.data.resize(qsizetype(indexCount) * (wideIndexes ? 4 : 2));
+    quint32 *indexes32 = reinterpret_cast<quint32 *>(mesh->m_indexBuffer.data.data());
+    quint16 *indexes16 = reinterpret_cast<quint16 *>(mesh->m_indexBuffer.data.data());
+    quint32 written = 0;
+    auto addIndex = [&](quint32 index) {
+        if (wideIndexes)
+            indexes32[written++] = index;
+        else
+            indexes16[written++] = quint16(index);
+    };
+    for (quint32 row = 0; row + 1 < rows; ++row) {
+        for (quint32 column = 0; column + 1 < columns; ++column) {
+            const quint32 corner = row * columns + column;
+            addIndex(corner);
+            addIndex(corner + columns);
+            addIndex(corner + 1);
+            addIndex(corner + 1);
+            addIndex(corner + columns);
+            addIndex(corner + columns + 1);
+        }
+    }
+
+    // Subsets split the triangles evenly, the last one takes the remainder
+    const quint32 triangleCount = indexCount / 3;
+    const quint32 subsetCount = qBound(1u, options.subsetCount, triangleCount);
+    const quint32 trianglesPerSubset = triangleCount / subsetCount;
+    for (quint32 i = 0; i < subsetCount; ++i) {
+        Mesh::MeshSubset subset;
+        subset.offset = i * trianglesPerSubset * 3;
+        subset.count = (i + 1 == subsetCount ? triangleCount - i * trianglesPerSubset : trianglesPerSubset) * 3;
+
+        QVector3D min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+        QVector3D max = -min;
+        for (quint32 j = subset.offset; j < subset.offset + subset.count; ++j) {
+            const quint32 index = wideIndexes ? indexes32[j] : indexes16[j];
+            float position[3];
+            memcpy(position, mesh->m_vertexBuffer.data.constData() + qsizetype(index) * stride, sizeof(position));
+            const QVector3D point(position[0], position[1], position[2]);
+            min = QVector3D(qMin(min.x(), point.x()), qMin(min.y(), point.y()), qMin(min.z(), point.z()));
+            max = QVector3D(qMax(max.x(), point.x()), qMax(max.y(), point.y()), qMax(max.z(), point.z()));
+        }
+        subset.bounds.min = min;
+        subset.bounds.max = max;
+
+        // UTF-16 with the terminator included in the length
+        const QString name = QStringLiteral("subset%1").arg(i);
+        subset.nameLength = name.size() + 1;
+        subset.name = QByteArray(reinterpret_cast<const char *>(name.utf16()), subset.nameLength * 2);
+        mesh->m_meshSubsets.append(subset);
+    }
+
+    // A simple chain of joints
+    for (quint32 i = 0; i < options.jointCount; ++i) {
+        Mesh::Joint joint;
+        joint.jointId = i;
+        joint.parentId = i > 0 ? i - 1 : 0;
+        mesh->m_joints.append(joint);
+    }
+
+    mesh->buildVertexLayout();
+    mesh->createSubsets();
+    return mesh;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2023 Andy Nichols <nezticle@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SYNTHETICMESH_H
+#define SYNTHETICMESH_H
+
+#include "mesh.h"
+
+// Builds meshes of a chosen size and vertex layout in memory, for
+// measuring the loader and the geometry generation on known data. The
+// vertexes form a rippled grid, so every attribute has plausible values.
+// The result can be used directly or saved like a loaded mesh, and is the
+// same for the same options.
+class SyntheticMesh
+{
+public:
+    struct Options {
+        quint32 vertexCount = 4096;
+        quint32 subsetCount = 1;
+        // UnsignedInt16 limits the mesh to 65536 vertexes
+        Mesh::ComponentType indexType = Mesh::UnsignedInt32;
+        bool normals = true;
+        bool tangents = true;
+        int uvChannels = 1;
+        bool colors = false;
+        // Adds joint and weight attributes and a joint table when not 0
+        quint32 jointCount = 0;
+        int morphTargets = 0;
+    };
+
+    static Mesh *create(const Options &options);
+
+    // Size of a vertex, and of a vertex with its share of the index
+    // buffer, which is roughly what each vertex adds to the file
+    static quint32 stride(const Options &options);
+    static quint32 bytesPerVertex(const Options &options);
+
+private:
+    static QVector<Mesh::VertexBufferEntry> vertexLayout(const Options &options);
+};
+
+#endif // SYNTHETICMESH_H
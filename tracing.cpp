@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2023 Andy Nichols <nezticle@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tracing.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QThread>
+#include <QVector>
+
+#include <vector>
+
+namespace {
+struct Event {
+    const char *name = nullptr;
+    qint64 start = 0;
+    qint64 duration = 0;
+};
+
+// Only written by its own thread, the newest events overwrite the oldest
+struct ThreadBuffer {
+    static const quint64 capacity = 64 * 1024;
+
+    int threadId = 0;
+    QString threadName;
+    std::vector<Event> events;
+    std::atomic<quint64> written = 0;
+};
+
+struct Registry {
+    QElapsedTimer clock;
+    QMutex mutex;
+    QVector<QSharedPointer<ThreadBuffer>> buffers;
+
+    Registry() { clock.start(); }
+};
+
+Registry &registry()
+{
+    static Registry registry;
+    return registry;
+}
+
+ThreadBuffer *threadBuffer()
+{
+    // Buffers are owned by the registry, so they outlive their threads
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (!buffer) {
+        auto newBuffer = QSharedPointer<ThreadBuffer>::create();
+        newBuffer->events.resize(ThreadBuffer::capacity);
+        QThread *thread = QThread::currentThread();
+        newBuffer->threadName = thread->objectName();
+        if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread())
+            newBuffer->threadName = QStringLiteral("main");
+
+        Registry &r = registry();
+        QMutexLocker locker(&r.mutex);
+        newBuffer->threadId = r.buffers.count() + 1;
+        if (newBuffer->threadName.isEmpty())
+            newBuffer->threadName = QStringLiteral("thread %1").arg(newBuffer->threadId);
+        r.buffers.append(newBuffer);
+        buffer = newBuffer.data();
+    }
+    return buffer;
+}
+
+QString &environmentTraceFile()
+{
+    static QString fileName;
+    return fileName;
+}
+}
+
+namespace Tracing {
+
+std::atomic<bool> enabled = false;
+
+void setEnabled(bool enable)
+{
+    // Starts the clock before the first span
+    registry();
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+qint64 now()
+{
+    return registry().clock.nsecsElapsed();
+}
+
+void record(const char *name, qint64 start, qint64 end)
+{
+    ThreadBuffer *buffer = threadBuffer();
+    const quint64 index = buffer->written.load(std::memory_order_relaxed);
+    Event &event = buffer->events[index % ThreadBuffer::capacity];
+    event.name = name;
+    event.start = start;
+    event.duration = end - start;
+    buffer->written.store(index + 1, std::memory_order_release);
+}
+
+bool writeChromeTrace(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Failed to open trace file" << fileName;
+        return false;
+    }
+
+    // Written by hand, a large trace would be slow to build as a QJsonDocument
+    const qint64 pid = QCoreApplication::applicationPid();
+    file.write("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    auto writeEvent = [&](const QByteArray &event) {
+        if (!first)
+            file.write(",\n");
+        first = false;
+        file.write(event);
+    };
+
+    Registry &r = registry();
+    QMutexLocker locker(&r.mutex);
+    for (const auto &buffer : std::as_const(r.buffers)) {
+        writeEvent(QByteArrayLiteral("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":") + QByteArray::number(pid)
+                   + ",\"tid\":" + QByteArray::number(buffer->threadId)
+                   + ",\"args\":{\"name\":\"" + buffer->threadName.toUtf8().replace('"', '\'') + "\"}}");
+
+        const quint64 written = buffer->written.load(std::memory_order_acquire);
+        const quint64 oldest = written > ThreadBuffer::capacity ? written - ThreadBuffer::capacity : 0;
+        for (quint64 i = oldest; i < written; ++i) {
+            const Event &event = buffer->events[i % ThreadBuffer::capacity];
+            // Microseconds, with the nanoseconds kept as fractions
+            writeEvent(QByteArrayLiteral("{\"ph\":\"X\",\"cat\":\"meshviewer\",\"name\":\"") + event.name
+                       + "\",\"pid\":" + QByteArray::number(pid)
+                       + ",\"tid\":" + QByteArray::number(buffer->threadId)
+                       + ",\"ts\":" + QByteArray::number(event.start / 1000.0, 'f', 3)
+                       + ",\"dur\":" + QByteArray::number(event.duration / 1000.0, 'f', 3) + "}");
+        }
+    }
+    file.write("\n]}\n");
+    return true;
+}
+
+void enableFromEnvironment()
+{
+    environmentTraceFile() = qEnvironmentVariable("MESHVIEWER_TRACE");
+    if (!environmentTraceFile().isEmpty())
+        setEnabled(true);
+}
+
+void writeTraceFromEnvironment()
+{
+    if (!environmentTraceFile().isEmpty())
+        writeChromeTrace(environmentTraceFile());
+}
+
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2023 Andy Nichols <nezticle@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <QString>
+
+#include <atomic>
+
+// Timing spans for finding out where loading and generation spend their
+// time. Each thread records into a ring buffer of its own, and the spans
+// can be written as a Chrome trace (chrome://tracing or ui.perfetto.dev).
+// Recording is off unless enabled, a disabled span only costs a flag check.
+namespace Tracing {
+
+extern std::atomic<bool> enabled;
+
+inline bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+void setEnabled(bool enable);
+
+// Nanoseconds since tracing was first used
+qint64 now();
+// name has to be a string literal, only the pointer is kept
+void record(const char *name, qint64 start, qint64 end);
+
+// Meant for when the work is done, spans recorded meanwhile may be missed
+bool writeChromeTrace(const QString &fileName);
+
+// Enables tracing when MESHVIEWER_TRACE names a file, the trace is
+// written there by writeTraceFromEnvironment()
+void enableFromEnvironment();
+void writeTraceFromEnvironment();
+
+}
+
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name)
+        : m_name(name)
+        , m_start(Tracing::isEnabled() ? Tracing::now() : -1)
+    {}
+    ~TraceSpan() { end(); }
+
+    // Ends the span before it goes out of scope
+    void end()
+    {
+        if (m_start >= 0)
+            Tracing::record(m_name, m_start, Tracing::now());
+        m_start = -1;
+    }
+
+    // Ends this span and starts the next phase
+    void next(const char *name)
+    {
+        end();
+        m_name = name;
+        m_start = Tracing::isEnabled() ? Tracing::now() : -1;
+    }
+
+private:
+    const char *m_name;
+    qint64 m_start;
+
+    Q_DISABLE_COPY(TraceSpan)
+};
+
+#endif // TRACING_H